@@ -42,6 +42,7 @@
 #include "comp_src.h"
 #include "pipeline.h"
 #include "decompress.h"
+#include "manifest.h"
 
 #ifdef HAVE_LIBZ
 
@@ -79,7 +80,7 @@ pipeline *decompress_open (const char *filename)
 	char *ext;
 	struct compression *comp;
 
-	if (stat (filename, &st) < 0 || S_ISDIR (st.st_mode))
+	if (manifest_stat (filename, &st) < 0 || S_ISDIR (st.st_mode))
 		return NULL;
 
 #ifdef HAVE_LIBZ
@@ -147,3 +148,73 @@ pipeline *decompress_fdopen (int fd)
 	pipeline_want_out (p, -1);
 	return p;
 }
+
+/* Read the whole of FILENAME, decompressing it if necessary, into a newly
+ * allocated buffer followed by a NUL byte, and set *LEN to its length.
+ * Return NULL if it cannot be read.
+ */
+char *decompress_read_file (const char *filename, size_t *len)
+{
+	char *buf = NULL;
+	size_t size = 0;
+	pipeline *p;
+#ifdef HAVE_LIBZ
+	const char *ext = strrchr (filename, '.');
+	struct compression *comp = NULL;
+
+	if (ext)
+		for (comp = comp_list; comp->ext; ++comp)
+			if (STREQ (comp->ext, ext + 1))
+				break;
+
+	/* zlib reads uncompressed files too, so there is no need to start
+	 * a decompression pipeline for either of the common cases.
+	 */
+	if (!comp || !comp->ext || STREQ (comp->ext, "gz")) {
+		gzFile zlibfile = gzopen (filename, "rb");
+
+		if (!zlibfile)
+			return NULL;
+		*len = 0;
+		for (;;) {
+			int r;
+
+			if (size - *len < 4096) {
+				size = size ? size * 2 : 65536;
+				buf = xrealloc (buf, size);
+			}
+			r = gzread (zlibfile, buf + *len, size - *len - 1);
+			if (r <= 0)
+				break;
+			*len += r;
+		}
+		gzclose (zlibfile);
+		buf[*len] = '\0';
+		return buf;
+	}
+#endif /* HAVE_LIBZ */
+
+	p = decompress_open (filename);
+	if (!p)
+		return NULL;
+	pipeline_start (p);
+	*len = 0;
+	for (;;) {
+		size_t n = 65536;
+		const char *block = pipeline_read (p, &n);
+
+		if (!block || !n)
+			break;
+		if (size - *len <= n) {
+			size = *len + n + 1;
+			buf = xrealloc (buf, size);
+		}
+		memcpy (buf + *len, block, n);
+		*len += n;
+	}
+	pipeline_free (p);
+	if (!buf)
+		buf = xmalloc (1);
+	buf[*len] = '\0';
+	return buf;
+}
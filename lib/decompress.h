@@ -37,4 +37,10 @@ pipeline *decompress_open (const char *filename);
  */
 pipeline *decompress_fdopen (int fd);
 
+/* Read the whole of FILENAME, decompressed, into a newly allocated
+ * NUL-terminated buffer, setting *LEN to its length.  Return NULL if it
+ * cannot be read.
+ */
+char *decompress_read_file (const char *filename, size_t *len);
+
 #endif /* MAN_DECOMPRESS_H */
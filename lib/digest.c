@@ -0,0 +1,172 @@
+/*
+ * digest.c: hash functions and message digests
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+
+#include "digest.h"
+
+/* Continue a 64-bit FNV-1a hash HASH (initially FNV_INIT) over LEN bytes
+ * of BUF.  This is quick and spreads similar inputs well, which is enough
+ * to tell apart things that are already known to be related, but it is
+ * not collision-resistant.
+ */
+uint64_t fnv_update (uint64_t hash, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		hash ^= p[i];
+		hash *= UINT64_C (0x100000001b3);
+	}
+	return hash;
+}
+
+/* Continue HASH over the string S including its terminating NUL, so that
+ * consecutive strings cannot run into one another.
+ */
+uint64_t fnv_update_string (uint64_t hash, const char *s)
+{
+	return fnv_update (hash, s, strlen (s) + 1);
+}
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/* Start computing a SHA-256 digest (FIPS 180-4) in CTX. */
+void sha256_init (struct sha256_ctx *ctx)
+{
+	static const uint32_t initial[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memcpy (ctx->state, initial, sizeof ctx->state);
+	ctx->length = 0;
+}
+
+static void sha256_block (struct sha256_ctx *ctx, const unsigned char *p)
+{
+	uint32_t w[64], s[8];
+	int i;
+
+	for (i = 0; i < 16; ++i)
+		w[i] = ((uint32_t) p[4 * i] << 24) |
+		       ((uint32_t) p[4 * i + 1] << 16) |
+		       ((uint32_t) p[4 * i + 2] << 8) |
+		       (uint32_t) p[4 * i + 3];
+	for (i = 16; i < 64; ++i) {
+		uint32_t s0 = ROR32 (w[i - 15], 7) ^ ROR32 (w[i - 15], 18) ^
+			      (w[i - 15] >> 3);
+		uint32_t s1 = ROR32 (w[i - 2], 17) ^ ROR32 (w[i - 2], 19) ^
+			      (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	memcpy (s, ctx->state, sizeof s);
+	for (i = 0; i < 64; ++i) {
+		uint32_t t1 = s[7] +
+			      (ROR32 (s[4], 6) ^ ROR32 (s[4], 11) ^
+			       ROR32 (s[4], 25)) +
+			      ((s[4] & s[5]) ^ (~s[4] & s[6])) +
+			      sha256_k[i] + w[i];
+		uint32_t t2 = (ROR32 (s[0], 2) ^ ROR32 (s[0], 13) ^
+			       ROR32 (s[0], 22)) +
+			      ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+
+		memmove (s + 1, s, 7 * sizeof *s);
+		s[4] += t1;
+		s[0] = t1 + t2;
+	}
+	for (i = 0; i < 8; ++i)
+		ctx->state[i] += s[i];
+}
+
+/* Add LEN bytes of BUF to the digest being computed in CTX. */
+void sha256_update (struct sha256_ctx *ctx, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	size_t used = ctx->length % 64;
+
+	ctx->length += len;
+	if (used) {
+		size_t n = 64 - used < len ? 64 - used : len;
+
+		memcpy (ctx->block + used, p, n);
+		p += n;
+		len -= n;
+		if (used + n < 64)
+			return;
+		sha256_block (ctx, ctx->block);
+	}
+	for (; len >= 64; p += 64, len -= 64)
+		sha256_block (ctx, p);
+	memcpy (ctx->block, p, len);
+}
+
+/* Finish the digest being computed in CTX, and store it in HEX as a
+ * string of hexadecimal digits.
+ */
+void sha256_finish (struct sha256_ctx *ctx, char hex[SHA256_HEX_SIZE])
+{
+	static const char xdigits[] = "0123456789abcdef";
+	uint64_t bits = ctx->length * 8;
+	unsigned char pad[72];
+	size_t pad_len = 64 - (ctx->length + 8) % 64;
+	int i;
+
+	memset (pad, 0, sizeof pad);
+	pad[0] = 0x80;
+	for (i = 0; i < 8; ++i)
+		pad[pad_len + i] = (unsigned char) (bits >> (56 - 8 * i));
+	sha256_update (ctx, pad, pad_len + 8);
+
+	for (i = 0; i < 32; ++i) {
+		unsigned char byte = ctx->state[i / 4] >> (24 - 8 * (i % 4));
+
+		hex[2 * i] = xdigits[byte >> 4];
+		hex[2 * i + 1] = xdigits[byte & 0xf];
+	}
+	hex[64] = '\0';
+}
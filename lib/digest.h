@@ -0,0 +1,50 @@
+/*
+ * digest.h: interface to hash functions and message digests
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MAN_DIGEST_H
+#define MAN_DIGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Initial value for fnv_update(). */
+#define FNV_INIT UINT64_C (0xcbf29ce484222325)
+
+extern uint64_t fnv_update (uint64_t hash, const void *buf, size_t len);
+extern uint64_t fnv_update_string (uint64_t hash, const char *s);
+
+struct sha256_ctx {
+	uint32_t state[8];
+	uint64_t length;		/* bytes so far */
+	unsigned char block[64];	/* pending partial block */
+};
+
+/* Size of a hexadecimal SHA-256 digest, including the terminating NUL. */
+#define SHA256_HEX_SIZE 65
+
+extern void sha256_init (struct sha256_ctx *ctx);
+extern void sha256_update (struct sha256_ctx *ctx,
+			   const void *buf, size_t len);
+extern void sha256_finish (struct sha256_ctx *ctx,
+			   char hex[SHA256_HEX_SIZE]);
+
+#endif /* MAN_DIGEST_H */
@@ -0,0 +1,777 @@
+/*
+ * manifest.c: record and consult per-hierarchy file metadata
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Looking up a page involves reading candidate section directories and
+ * stat()ing a number of files, which is slow when the hierarchy lives on
+ * a network file system.  mandb therefore writes a manifest describing
+ * every file in each section directory of a hierarchy, and programs that
+ * register it answer existence and metadata questions from the manifest
+ * instead, as long as the directory concerned has not been modified since
+ * the manifest was written.  This costs one stat() per directory rather
+ * than a readdir() and a stat() per file.
+ *
+ * The manifest is a text file.  Its first line is MANIFEST_HEADER, and
+ * each subsequent line describes one file using the following
+ * tab-separated fields:
+ *
+ *   path	relative to the top of the hierarchy
+ *   mode	in octal
+ *   nlink
+ *   size
+ *   mtime	as seconds.nanoseconds
+ *   inode
+ *   target	of a symbolic link, or "-"
+ *   comp	compression extension, or "-"
+ *
+ * The top of the hierarchy is listed as ".".  Each section directory is
+ * listed (with a path containing no slash) before the files it contains.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "areadlink.h"
+#include "dirname.h"
+#include "stat-time.h"
+#include "timespec.h"
+#include "xvasprintf.h"
+
+#include "manconfig.h"
+
+#include "cleanup.h"
+#include "digest.h"
+#include "hashtable.h"
+#include "manifest.h"
+
+#define MANIFEST_HEADER "man-db manifest 1"
+#define MANIFEST_FIELDS 8
+
+struct manifest_entry {
+	mode_t mode;
+	nlink_t nlink;
+	off_t size;
+	struct timespec mtime;
+	ino_t ino;
+	char *target;
+	char *comp;
+};
+
+struct manifest_dir {
+	struct manifest_entry self;
+	int fresh;			/* -1 until checked */
+	struct hashtable *entries;	/* base name -> struct manifest_entry */
+	char **names;
+	size_t names_len, names_max;
+};
+
+struct manifest {
+	char *manpath;
+	char *file;
+	int loaded;			/* 1 if loaded, -1 if unusable */
+	struct hashtable *dirs;		/* section -> struct manifest_dir */
+	struct manifest *next;
+};
+
+static struct manifest *manifests;
+
+static void manifest_entry_free (void *defn)
+{
+	struct manifest_entry *entry = defn;
+
+	free (entry->target);
+	free (entry->comp);
+	free (entry);
+}
+
+static void manifest_dir_free (void *defn)
+{
+	struct manifest_dir *dir = defn;
+	size_t i;
+
+	hashtable_free (dir->entries);
+	for (i = 0; i < dir->names_len; ++i)
+		free (dir->names[i]);
+	free (dir->names);
+	free (dir->self.target);
+	free (dir->self.comp);
+	free (dir);
+}
+
+static void manifest_unload (struct manifest *m)
+{
+	if (m->dirs)
+		hashtable_free (m->dirs);
+	m->dirs = NULL;
+	m->loaded = 0;
+}
+
+static void manifests_free (void *data ATTRIBUTE_UNUSED)
+{
+	while (manifests) {
+		struct manifest *next = manifests->next;
+
+		manifest_unload (manifests);
+		free (manifests->manpath);
+		free (manifests->file);
+		free (manifests);
+		manifests = next;
+	}
+}
+
+/* hashtable_lookup() only compares the first LEN characters, which is
+ * not enough when looking up a name that is not NUL-terminated.
+ */
+static void *lookup_exact (const struct hashtable *ht,
+			   const char *name, size_t len)
+{
+	struct nlist *np = hashtable_lookup_structure (ht, name, len);
+
+	if (np && np->name[len] == '\0')
+		return np->defn;
+	return NULL;
+}
+
+/* Parse one line of a manifest into *PATH (pointing into LINE) and
+ * *ENTRY.  Returns non-zero on success.
+ */
+static int parse_line (char *line, char **path, struct manifest_entry *entry)
+{
+	char *fields[MANIFEST_FIELDS];
+	char *end;
+	unsigned long long size, ino;
+	long sec, nsec;
+	int i;
+
+	end = strchr (line, '\n');
+	if (end)
+		*end = '\0';
+	for (i = 0; i < MANIFEST_FIELDS; ++i) {
+		fields[i] = line;
+		line = strchr (line, '\t');
+		if (i < MANIFEST_FIELDS - 1) {
+			if (!line)
+				return 0;
+			*line++ = '\0';
+		} else if (line)
+			return 0;
+	}
+
+	*path = fields[0];
+	if (!**path)
+		return 0;
+	entry->mode = (mode_t) strtoul (fields[1], &end, 8);
+	if (*end)
+		return 0;
+	entry->nlink = (nlink_t) strtoul (fields[2], &end, 10);
+	if (*end)
+		return 0;
+	size = strtoull (fields[3], &end, 10);
+	if (*end)
+		return 0;
+	entry->size = (off_t) size;
+	if (sscanf (fields[4], "%ld.%ld", &sec, &nsec) != 2)
+		return 0;
+	entry->mtime.tv_sec = (time_t) sec;
+	entry->mtime.tv_nsec = nsec;
+	ino = strtoull (fields[5], &end, 10);
+	if (*end)
+		return 0;
+	entry->ino = (ino_t) ino;
+	entry->target = STREQ (fields[6], "-") ? NULL : xstrdup (fields[6]);
+	entry->comp = STREQ (fields[7], "-") ? NULL : xstrdup (fields[7]);
+
+	return 1;
+}
+
+static void manifest_load (struct manifest *m)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t n = 0;
+
+	m->loaded = -1;
+
+	fp = fopen (m->file, "r");
+	if (!fp) {
+		debug ("can't open manifest %s\n", m->file);
+		return;
+	}
+
+	if (getline (&line, &n, fp) < 0 ||
+	    !STREQ (line, MANIFEST_HEADER "\n")) {
+		debug ("%s is not a manifest\n", m->file);
+		goto out;
+	}
+
+	m->dirs = hashtable_create (&manifest_dir_free);
+	while (getline (&line, &n, fp) >= 0) {
+		char *path, *slash;
+		struct manifest_entry entry;
+		struct manifest_dir *dir;
+
+		if (!parse_line (line, &path, &entry)) {
+			debug ("malformed line in manifest %s\n", m->file);
+			manifest_unload (m);
+			m->loaded = -1;
+			goto out;
+		}
+
+		slash = strchr (path, '/');
+		if (!slash) {
+			dir = XZALLOC (struct manifest_dir);
+			dir->self = entry;
+			dir->fresh = -1;
+			dir->entries = hashtable_create
+				(&manifest_entry_free);
+			hashtable_install (m->dirs, path, strlen (path), dir);
+			continue;
+		}
+
+		*slash = '\0';
+		dir = lookup_exact (m->dirs, path, strlen (path));
+		if (!dir || strchr (slash + 1, '/')) {
+			/* Files not directly within a listed section
+			 * directory are not looked up, so ignore them.
+			 */
+			free (entry.target);
+			free (entry.comp);
+			continue;
+		}
+
+		hashtable_install (dir->entries, slash + 1, strlen (slash + 1),
+				   xmemdup (&entry, sizeof entry));
+		if (dir->names_len >= dir->names_max) {
+			dir->names_max = dir->names_max ?
+				dir->names_max * 2 : 64;
+			dir->names = xnrealloc (dir->names, dir->names_max,
+						sizeof *dir->names);
+		}
+		dir->names[dir->names_len++] = xstrdup (slash + 1);
+	}
+
+	debug ("loaded manifest %s\n", m->file);
+	m->loaded = 1;
+
+out:
+	free (line);
+	fclose (fp);
+}
+
+/* Has a directory changed since its manifest entry was recorded? */
+static int dir_is_fresh (const char *path, const struct manifest_entry *self)
+{
+	struct stat st;
+
+	if (stat (path, &st) < 0 || !S_ISDIR (st.st_mode))
+		return 0;
+	return st.st_ino == self->ino &&
+	       timespec_cmp (get_stat_mtime (&st), self->mtime) == 0;
+}
+
+/* Find the manifest section directory covering the directory PATH (of
+ * length LEN, not necessarily NUL-terminated).  Returns NULL if it is not
+ * an immediate subdirectory of a registered hierarchy, if the manifest
+ * cannot be used, or if the directory has changed since the manifest was
+ * written.
+ */
+static struct manifest_dir *find_dir (const char *path, size_t len)
+{
+	struct manifest *m;
+
+	for (m = manifests; m; m = m->next) {
+		size_t mlen = strlen (m->manpath);
+		const char *sub;
+		struct manifest_dir *dir;
+
+		if (len <= mlen + 1 || path[mlen] != '/' ||
+		    strncmp (path, m->manpath, mlen) != 0)
+			continue;
+		sub = path + mlen + 1;
+		if (memchr (sub, '/', len - mlen - 1))
+			continue;
+
+		if (!m->loaded)
+			manifest_load (m);
+		if (m->loaded < 0)
+			return NULL;
+
+		dir = lookup_exact (m->dirs, sub, len - mlen - 1);
+		if (!dir)
+			return NULL;
+		if (dir->fresh < 0) {
+			char *dirpath = xstrndup (path, len);
+			dir->fresh = dir_is_fresh (dirpath, &dir->self);
+			debug ("manifest entry for %s is %s\n", dirpath,
+			       dir->fresh ? "fresh" : "stale");
+			free (dirpath);
+		}
+		return dir->fresh ? dir : NULL;
+	}
+
+	return NULL;
+}
+
+/* Record that the manifest for the hierarchy MANPATH is in FILE.  It is
+ * only read if a lookup is made within MANPATH.
+ */
+void manifest_register (const char *manpath, const char *file)
+{
+	struct manifest *m;
+
+	for (m = manifests; m; m = m->next)
+		if (STREQ (m->manpath, manpath))
+			return;
+
+	if (!manifests)
+		push_cleanup (manifests_free, NULL, 0);
+
+	m = XZALLOC (struct manifest);
+	m->manpath = xstrdup (manpath);
+	m->file = xstrdup (file);
+	m->next = manifests;
+	manifests = m;
+}
+
+/* If a fresh manifest covers the directory PATH, set *NAMES to a newly
+ * allocated array of the names it contains (which the caller should
+ * free), set *NAMES_LEN, and return 0.  Otherwise, return -1; the caller
+ * should read the directory itself.
+ */
+int manifest_list_directory (const char *path,
+			     char ***names, size_t *names_len)
+{
+	struct manifest_dir *dir = find_dir (path, strlen (path));
+	size_t i;
+
+	if (!dir)
+		return -1;
+
+	*names = XNMALLOC (dir->names_len ? dir->names_len : 1, char *);
+	for (i = 0; i < dir->names_len; ++i)
+		(*names)[i] = xstrdup (dir->names[i]);
+	*names_len = dir->names_len;
+	return 0;
+}
+
+static void fill_stat (const struct manifest_entry *entry, struct stat *buf)
+{
+	memset (buf, 0, sizeof *buf);
+	buf->st_mode = entry->mode;
+	buf->st_nlink = entry->nlink;
+	buf->st_size = entry->size;
+	buf->st_ino = entry->ino;
+	buf->st_mtime = entry->mtime.tv_sec;
+#if defined STAT_TIMESPEC
+	STAT_TIMESPEC (buf, st_mtim).tv_nsec = entry->mtime.tv_nsec;
+#elif defined STAT_TIMESPEC_NS
+	STAT_TIMESPEC_NS (buf, st_mtim) = entry->mtime.tv_nsec;
+#endif
+}
+
+static int lookup_stat (const char *file, struct stat *buf, int follow)
+{
+	const char *slash = strrchr (file, '/');
+	struct manifest_dir *dir = NULL;
+	const struct manifest_entry *entry;
+	int depth;
+
+	if (slash)
+		dir = find_dir (file, slash - file);
+	if (!dir)
+		return follow ? stat (file, buf) : lstat (file, buf);
+
+	entry = lookup_exact (dir->entries, slash + 1, strlen (slash + 1));
+	/* Manual page symlinks nearly always point elsewhere in the same
+	 * directory, so we can follow those; anything else needs the real
+	 * file system.
+	 */
+	for (depth = 0; entry && follow && S_ISLNK (entry->mode); ++depth) {
+		if (depth >= 8 || !entry->target ||
+		    strchr (entry->target, '/'))
+			return stat (file, buf);
+		entry = lookup_exact (dir->entries, entry->target,
+				      strlen (entry->target));
+	}
+	if (!entry) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	fill_stat (entry, buf);
+	return 0;
+}
+
+/* Drop-in replacements for stat() and lstat() that answer from a fresh
+ * manifest if possible.  Only the type and permission bits, link count,
+ * size, modification time, and inode number are filled in.
+ */
+int manifest_stat (const char *file, struct stat *buf)
+{
+	return lookup_stat (file, buf, 1);
+}
+
+int manifest_lstat (const char *file, struct stat *buf)
+{
+	return lookup_stat (file, buf, 0);
+}
+
+static int compare_names (const void *a, const void *b)
+{
+	const char *left = *(const char **) a;
+	const char *right = *(const char **) b;
+	return strcmp (left, right);
+}
+
+/* Read the names in directory PATH, sorted, excluding "." and "..".  If
+ * SECTIONS_ONLY is set, only read names that look like section
+ * directories.  Returns 0 on success, or -1 if the directory cannot be
+ * read or contains a name that cannot be represented in the manifest.
+ */
+static int read_names (const char *path, int sections_only,
+		       char ***namesp, size_t *names_len)
+{
+	DIR *dir;
+	struct dirent *ent;
+	char **names = NULL;
+	size_t names_max = 0;
+
+	*namesp = NULL;
+	*names_len = 0;
+	dir = opendir (path);
+	if (!dir)
+		return -1;
+	while ((ent = readdir (dir)) != NULL) {
+		if (STREQ (ent->d_name, ".") || STREQ (ent->d_name, ".."))
+			continue;
+		if (sections_only && !STRNEQ (ent->d_name, "man", 3) &&
+		    !STRNEQ (ent->d_name, "cat", 3))
+			continue;
+		if (strpbrk (ent->d_name, "\t\n")) {
+			if (sections_only)
+				continue;
+			debug ("unrepresentable name in %s; not listing it "
+			       "in manifest\n", path);
+			while (*names_len)
+				free (names[--*names_len]);
+			free (names);
+			closedir (dir);
+			return -1;
+		}
+		if (*names_len >= names_max) {
+			names_max = names_max ? names_max * 2 : 64;
+			names = xnrealloc (names, names_max, sizeof *names);
+		}
+		names[(*names_len)++] = xstrdup (ent->d_name);
+	}
+	closedir (dir);
+
+	if (names)
+		qsort (names, *names_len, sizeof *names, &compare_names);
+	*namesp = names;
+	return 0;
+}
+
+static const char *comp_extension (const char *name)
+{
+#ifdef COMP_SRC
+	const char *dot = strrchr (name, '.');
+	struct compression *comp;
+
+	if (dot)
+		for (comp = comp_list; comp->ext; ++comp)
+			if (STREQ (dot + 1, comp->ext))
+				return comp->ext;
+#endif /* COMP_SRC */
+	return NULL;
+}
+
+static void write_entry (FILE *fp, const char *rel, const char *path,
+			 const struct stat *st)
+{
+	struct timespec mtime = get_stat_mtime (st);
+	const char *comp = S_ISDIR (st->st_mode) ? NULL : comp_extension (rel);
+	char *target = NULL;
+
+	if (S_ISLNK (st->st_mode)) {
+		target = areadlink_with_size (path, st->st_size);
+		if (target && strpbrk (target, "\t\n")) {
+			free (target);
+			target = NULL;
+		}
+	}
+
+	fprintf (fp, "%s\t%lo\t%lu\t%llu\t%ld.%09ld\t%llu\t%s\t%s\n",
+		 rel, (unsigned long) st->st_mode,
+		 (unsigned long) st->st_nlink,
+		 (unsigned long long) st->st_size,
+		 (long) mtime.tv_sec, (long) mtime.tv_nsec,
+		 (unsigned long long) st->st_ino,
+		 target ? target : "-", comp ? comp : "-");
+
+	free (target);
+}
+
+static void write_dir (FILE *fp, const char *manpath, const char *sub)
+{
+	char *path = xasprintf ("%s/%s", manpath, sub);
+	struct stat st;
+	char **names;
+	size_t names_len, i;
+
+	/* Take the directory's timestamp before reading it, so that any
+	 * change made while we're reading makes the entry look stale.
+	 */
+	if (stat (path, &st) < 0 || !S_ISDIR (st.st_mode)) {
+		free (path);
+		return;
+	}
+	if (read_names (path, 0, &names, &names_len) < 0) {
+		free (path);
+		return;
+	}
+
+	write_entry (fp, sub, path, &st);
+	for (i = 0; i < names_len; ++i) {
+		char *file = xasprintf ("%s/%s", path, names[i]);
+		char *rel = xasprintf ("%s/%s", sub, names[i]);
+		struct stat file_st;
+
+		if (lstat (file, &file_st) == 0)
+			write_entry (fp, rel, file, &file_st);
+
+		free (rel);
+		free (file);
+		free (names[i]);
+	}
+
+	free (names);
+	free (path);
+}
+
+/* Write a manifest of the hierarchy MANPATH to FILE, replacing it
+ * atomically.  Returns 0 on success, or -1 with errno set on failure.
+ */
+int manifest_write (const char *manpath, const char *file)
+{
+	char *tmpfile;
+	FILE *fp;
+	struct stat st;
+	char **sections;
+	size_t sections_len, i;
+	int saved_errno;
+
+	if (stat (manpath, &st) < 0)
+		return -1;
+
+	tmpfile = xasprintf ("%s.%d", file, getpid ());
+	fp = fopen (tmpfile, "w");
+	if (!fp) {
+		saved_errno = errno;
+		free (tmpfile);
+		errno = saved_errno;
+		return -1;
+	}
+
+	fputs (MANIFEST_HEADER "\n", fp);
+	write_entry (fp, ".", manpath, &st);
+	if (read_names (manpath, 1, &sections, &sections_len) < 0)
+		sections_len = 0;
+	for (i = 0; i < sections_len; ++i) {
+		write_dir (fp, manpath, sections[i]);
+		free (sections[i]);
+	}
+	free (sections);
+
+	if (ferror (fp) || fclose (fp) != 0 || rename (tmpfile, file) < 0) {
+		saved_errno = errno;
+		unlink (tmpfile);
+		free (tmpfile);
+		errno = saved_errno;
+		return -1;
+	}
+	chmod (file, DBMODE);
+
+	debug ("wrote manifest %s for %s\n", file, manpath);
+	free (tmpfile);
+	return 0;
+}
+
+/* Is FILE directly within the directory PATH? */
+static int in_directory (const char *file, const char *path)
+{
+	char *dir = dir_name (file);
+	struct stat dir_st, path_st;
+	int ret;
+
+	ret = stat (dir, &dir_st) == 0 && stat (path, &path_st) == 0 &&
+	      dir_st.st_dev == path_st.st_dev &&
+	      dir_st.st_ino == path_st.st_ino;
+	free (dir);
+	return ret;
+}
+
+/* Have any section directories been added to MANPATH since the manifest M
+ * was written?  Removed ones are noticed when checking them.
+ */
+static int sections_added (const char *manpath, struct manifest *m)
+{
+	char **sections;
+	size_t sections_len, i;
+	int added = 0;
+
+	if (read_names (manpath, 1, &sections, &sections_len) < 0)
+		return 1;
+	for (i = 0; i < sections_len; ++i) {
+		if (!added && !lookup_exact (m->dirs, sections[i],
+					     strlen (sections[i]))) {
+			char *path = xasprintf ("%s/%s", manpath,
+						sections[i]);
+
+			/* Only directories are listed. */
+			added = is_directory (path) == 1;
+			free (path);
+		}
+		free (sections[i]);
+	}
+	free (sections);
+	return added;
+}
+
+/* Check whether FILE is an up-to-date manifest for MANPATH: that is,
+ * whether neither the top of the hierarchy nor any of the section
+ * directories listed in it have been modified since it was written.
+ * Adding a section directory modifies the top of the hierarchy.
+ *
+ * If FILE is kept at the top of the hierarchy itself, then so are the
+ * databases and other files written alongside it, which modify the top
+ * of the hierarchy whenever they are created or replaced.  In that case,
+ * check for new section directories by reading the top of the hierarchy
+ * instead.
+ */
+int manifest_is_current (const char *manpath, const char *file)
+{
+	struct manifest m;
+	struct hashtable_iter *iter = NULL;
+	const struct nlist *elt;
+	int current = 1;
+	int shared_top;
+
+	memset (&m, 0, sizeof m);
+	m.file = (char *) file;
+	manifest_load (&m);
+	if (m.loaded < 0)
+		return 0;
+
+	shared_top = in_directory (file, manpath);
+	if (shared_top && sections_added (manpath, &m)) {
+		debug ("manifest %s is out of date for %s\n", file, manpath);
+		current = 0;
+	}
+
+	while ((elt = hashtable_iterate (m.dirs, &iter)) != NULL) {
+		struct manifest_dir *dir = elt->defn;
+		char *path;
+
+		if (!current)
+			continue;
+		if (STREQ (elt->name, ".")) {
+			if (shared_top)
+				continue;
+			path = xstrdup (manpath);
+		} else
+			path = xasprintf ("%s/%s", manpath, elt->name);
+		if (!dir_is_fresh (path, &dir->self)) {
+			debug ("manifest %s is out of date for %s\n",
+			       file, path);
+			current = 0;
+		}
+		free (path);
+	}
+
+	manifest_unload (&m);
+	return current;
+}
+
+/* Return a digest of the contents of the hierarchy described by the
+ * manifest in FILE, as a newly allocated hexadecimal string, or NULL if
+ * FILE cannot be read.  Only the names, types, sizes, modification times,
+ * and link targets of files are included, since identical installations
+ * on different systems will disagree about inode numbers and directory
+ * timestamps.  Files in cat directories are left out, since they come and
+ * go as pages are viewed.
+ */
+char *manifest_digest (const char *file)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t n = 0;
+	uint64_t hash = FNV_INIT;
+	char *digest = NULL;
+
+	fp = fopen (file, "r");
+	if (!fp)
+		return NULL;
+
+	if (getline (&line, &n, fp) < 0 ||
+	    !STREQ (line, MANIFEST_HEADER "\n"))
+		goto out;
+
+	while (getline (&line, &n, fp) >= 0) {
+		char *path;
+		struct manifest_entry entry;
+
+		if (!parse_line (line, &path, &entry))
+			goto out;
+		if (!S_ISDIR (entry.mode) && !STRNEQ (path, "cat", 3)) {
+			char *data = xasprintf ("%lo %llu %ld.%09ld",
+						(unsigned long)
+						(entry.mode & S_IFMT),
+						(unsigned long long) entry.size,
+						(long) entry.mtime.tv_sec,
+						(long) entry.mtime.tv_nsec);
+			hash = fnv_update_string (hash, path);
+			hash = fnv_update_string (hash, data);
+			hash = fnv_update_string (hash, entry.target ?
+							entry.target : "");
+			free (data);
+		}
+		free (entry.target);
+		free (entry.comp);
+	}
+
+	digest = xasprintf ("%016llx", (unsigned long long) hash);
+
+out:
+	free (line);
+	fclose (fp);
+	return digest;
+}
@@ -0,0 +1,39 @@
+/*
+ * manifest.h: interface to per-hierarchy file metadata manifests
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MAN_MANIFEST_H
+#define MAN_MANIFEST_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+extern void manifest_register (const char *manpath, const char *file);
+extern int manifest_write (const char *manpath, const char *file);
+extern int manifest_is_current (const char *manpath, const char *file);
+extern char *manifest_digest (const char *file);
+
+extern int manifest_list_directory (const char *path,
+				    char ***names, size_t *names_len);
+extern int manifest_stat (const char *file, struct stat *buf);
+extern int manifest_lstat (const char *file, struct stat *buf);
+
+#endif /* MAN_MANIFEST_H */
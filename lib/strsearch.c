@@ -0,0 +1,304 @@
+/*
+ * strsearch.c: fast substring search
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Searching is done with the Boyer-Moore-Horspool algorithm, which
+ * compares the last byte of the text under the end of the pattern first
+ * and, if it does not match, moves the pattern along as far as that byte
+ * allows.  For all but the shortest patterns this skips most of the text,
+ * and it works on buffers containing NUL bytes, so that a whole page can
+ * be searched at once.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "minmax.h"
+
+#include "manconfig.h"
+
+#include "pipeline.h"
+
+#include "strsearch.h"
+
+struct strsearch {
+	unsigned char *needle;		/* folded if ignoring case */
+	size_t len;
+	int icase;
+	unsigned char fold[UCHAR_MAX + 1];
+	size_t skip[UCHAR_MAX + 1];
+};
+
+struct strsearch *strsearch_new (const char *needle, int icase)
+{
+	struct strsearch *search = XMALLOC (struct strsearch);
+	size_t i;
+
+	search->len = strlen (needle);
+	search->needle = xmalloc (search->len + 1);
+	search->icase = icase;
+	for (i = 0; i <= UCHAR_MAX; ++i)
+		search->fold[i] = icase ? tolower (i) : i;
+	for (i = 0; i < search->len; ++i)
+		search->needle[i] = search->fold[(unsigned char) needle[i]];
+	search->needle[search->len] = '\0';
+
+	for (i = 0; i <= UCHAR_MAX; ++i)
+		search->skip[i] = search->len;
+	for (i = 0; i + 1 < search->len; ++i)
+		search->skip[search->needle[i]] = search->len - 1 - i;
+
+	return search;
+}
+
+void strsearch_free (struct strsearch *search)
+{
+	if (!search)
+		return;
+	free (search->needle);
+	free (search);
+}
+
+const char *strsearch_find (const struct strsearch *search,
+			    const char *haystack, size_t len)
+{
+	const unsigned char *text = (const unsigned char *) haystack;
+	const unsigned char *needle = search->needle;
+	const unsigned char *fold = search->fold;
+	size_t last, pos;
+
+	if (!search->len)
+		return haystack;
+	if (len < search->len)
+		return NULL;
+	if (search->len == 1 && !search->icase)
+		return memchr (haystack, needle[0], len);
+
+	last = search->len - 1;
+	for (pos = 0; pos <= len - search->len;
+	     pos += search->skip[fold[text[pos + last]]]) {
+		size_t i;
+
+		if (fold[text[pos + last]] != needle[last])
+			continue;
+		for (i = 0; i < last && fold[text[pos + i]] == needle[i]; ++i)
+			;
+		if (i == last)
+			return haystack + pos;
+	}
+
+	return NULL;
+}
+
+int strsearch_pipeline (const struct strsearch *search, pipeline *p)
+{
+	/* The last few bytes of the previous block, followed by the first
+	 * few bytes of the current one.
+	 */
+	size_t keep = search->len ? search->len - 1 : 0;
+	char *junction = xmalloc (2 * keep + 1);
+	size_t tail = 0;
+	int found = 0;
+
+	if (!search->len)
+		found = 1;
+
+	while (!found) {
+		size_t n = 65536;
+		const char *block = pipeline_read (p, &n);
+
+		if (!block || !n)
+			break;
+
+		if (tail) {
+			memcpy (junction + tail, block, MIN (n, keep));
+			if (strsearch_find (search, junction,
+					    tail + MIN (n, keep)))
+				found = 1;
+		}
+		if (!found && strsearch_find (search, block, n))
+			found = 1;
+
+		if (n >= keep) {
+			memcpy (junction, block + n - keep, keep);
+			tail = keep;
+		} else {
+			size_t drop;
+
+			memcpy (junction + tail, block, n);
+			tail += n;
+			drop = tail > keep ? tail - keep : 0;
+			memmove (junction, junction + drop, tail - drop);
+			tail -= drop;
+		}
+	}
+
+	free (junction);
+	return found;
+}
+
+/* Return the longest string that any match of the extended regular
+ * expression PATTERN must contain, or NULL if there is none that is easy
+ * to find.  This is deliberately cautious: it ignores anything in
+ * parentheses, and gives up on alternation.
+ */
+char *strsearch_regex_literal (const char *pattern)
+{
+	char *run = xmalloc (strlen (pattern) + 1);
+	char *best = NULL;
+	size_t run_len = 0, best_len = 0;
+	size_t last_char = 0;		/* start of the run's last character */
+	const char *p = pattern;
+	int depth = 0;
+
+	if (strchr (pattern, '|')) {
+		free (run);
+		return NULL;
+	}
+
+#define END_RUN \
+	do { \
+		if (run_len > best_len) { \
+			free (best); \
+			best = xstrndup (run, run_len); \
+			best_len = run_len; \
+		} \
+		run_len = 0; \
+		last_char = 0; \
+	} while (0)
+
+	/* Multibyte characters must be kept whole, so that dropping an
+	 * optional character does not leave part of it behind.
+	 */
+#define ADD_CHAR(c) \
+	do { \
+		int char_len = mblen ((c), MB_CUR_MAX); \
+		if (char_len < 1) \
+			char_len = 1; \
+		last_char = run_len; \
+		memcpy (run + run_len, (c), char_len); \
+		run_len += char_len; \
+		(c) += char_len; \
+	} while (0)
+
+	mblen (NULL, 0);
+
+	while (*p) {
+		switch (*p) {
+			case '[':
+				END_RUN;
+				++p;
+				if (*p == '^')
+					++p;
+				if (*p == ']')
+					++p;
+				while (*p && *p != ']') {
+					if (*p == '[' && (p[1] == ':' ||
+							  p[1] == '.' ||
+							  p[1] == '=')) {
+						char close = p[1];
+
+						p += 2;
+						while (*p && !(*p == close &&
+							       p[1] == ']'))
+							++p;
+						if (*p)
+							++p;
+					}
+					if (*p)
+						++p;
+				}
+				if (*p)
+					++p;
+				break;
+			case '(':
+				END_RUN;
+				++depth;
+				++p;
+				break;
+			case ')':
+				END_RUN;
+				if (depth)
+					--depth;
+				++p;
+				break;
+			case '*':
+			case '?':
+			case '{':
+				/* The previous character is optional. */
+				run_len = last_char;
+				END_RUN;
+				if (*p == '{') {
+					while (*p && *p != '}')
+						++p;
+				}
+				if (*p)
+					++p;
+				break;
+			case '+':
+			case '.':
+			case '^':
+			case '$':
+				END_RUN;
+				++p;
+				break;
+			case '\\':
+				/* Only these are escaped literals; GNU regex
+				 * gives others, such as \< and \w, special
+				 * meanings of their own.
+				 */
+				if (p[1] && strchr (".[]()*+?{}|^$\\", p[1])) {
+					++p;
+					if (depth) {
+						END_RUN;
+						++p;
+					} else
+						ADD_CHAR (p);
+				} else {
+					END_RUN;
+					if (*++p) {
+						int len = mblen (p, MB_CUR_MAX);
+						p += len < 1 ? 1 : len;
+					}
+				}
+				break;
+			default:
+				if (depth) {
+					END_RUN;
+					++p;
+				} else
+					ADD_CHAR (p);
+				break;
+		}
+	}
+	END_RUN;
+
+#undef ADD_CHAR
+#undef END_RUN
+
+	free (run);
+	return best;
+}
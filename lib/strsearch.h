@@ -0,0 +1,55 @@
+/*
+ * strsearch.h: interface to fast substring search
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef MAN_STRSEARCH_H
+#define MAN_STRSEARCH_H
+
+#include "pipeline.h"
+
+struct strsearch;
+
+/* Prepare to search for NEEDLE, ignoring case as strcasestr does if ICASE
+ * is set.
+ */
+struct strsearch *strsearch_new (const char *needle, int icase);
+
+void strsearch_free (struct strsearch *search);
+
+/* Return the first match for SEARCH in the LEN bytes at HAYSTACK, which
+ * may contain NUL bytes, or NULL if there is none.
+ */
+const char *strsearch_find (const struct strsearch *search,
+			    const char *haystack, size_t len);
+
+/* Return non-zero if the output of the started pipeline P contains a
+ * match for SEARCH, reading it in blocks and stopping as soon as a match
+ * is found.  Matches that straddle two blocks are found too.
+ */
+int strsearch_pipeline (const struct strsearch *search, pipeline *p);
+
+/* Return the longest string that every match of the extended regular
+ * expression PATTERN must contain, or NULL if there is none that is easy
+ * to find.
+ */
+char *strsearch_regex_literal (const char *pattern);
+
+#endif /* MAN_STRSEARCH_H */
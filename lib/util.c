@@ -54,6 +54,7 @@
 
 #include "error.h"
 #include "pipeline.h"
+#include "manifest.h"
 
 /*
  * Does file a have a different timestamp to file b?
@@ -80,11 +81,11 @@ int is_changed (const char *fa, const char *fb)
 
 	debug ("is_changed: a=%s, b=%s", fa, fb);
 
-	fa_stat = stat (fa, &fa_sb);
+	fa_stat = manifest_stat (fa, &fa_sb);
 	if (fa_stat != 0)
 		status = 1;
 
-	fb_stat = stat (fb, &fb_sb);
+	fb_stat = manifest_stat (fb, &fb_sb);
 	if (fb_stat != 0)
 		status |= 2;
 
@@ -114,7 +115,7 @@ int is_directory (const char *path)
 	struct stat sb;
 	int status;
 
-	status = stat (path, &sb);
+	status = manifest_stat (path, &sb);
 
 	if (status != 0)
 		return status;
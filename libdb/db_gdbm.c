@@ -93,7 +93,7 @@ man_gdbm_wrapper man_gdbm_open_wrapper (const char *name, int flags)
 		 */
 		memset (&key, 0, sizeof key);
 		MYDBM_SET (key, xstrdup (VER_KEY));
-		content = MYDBM_FETCH (wrap, key);
+		content = MYDBM_BASE_FETCH (wrap, key);
 		MYDBM_FREE_DPTR (key);
 		MYDBM_FREE_DPTR (content);
 	}
@@ -0,0 +1,1162 @@
+/*
+ * db_log.c: append-only log of changes to a database
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Changing a database in place would let readers see it half-updated,
+ * and copying all of it for each update costs I/O in proportion to the
+ * size of the database rather than to the size of the change.  Instead,
+ * handles opened for writing leave the database itself alone and append
+ * the changes made through them to a log next to it, named by adding
+ * DB_LOG_EXT to the name of the database.  Every handle reads the log
+ * when it is opened and lays it over the database, and mandb occasionally
+ * folds the log into a new copy of the database (see dblog_compact()).
+ *
+ * The log starts with the following newline-terminated header lines:
+ *
+ *   man-db database log 1
+ *   base <device> <inode> <modification time of the database>
+ *
+ * identifying the database that it applies to; a log whose database has
+ * since been replaced is ignored.  Then come batches of changes, one for
+ * each handle that changed anything:
+ *
+ *   batch <length of records>
+ *   <records>
+ *   end
+ *
+ * where each record is one of:
+ *
+ *   S <key length> <content length>\n<key><content>\n	store
+ *   D <key length>\n<key>\n				delete
+ *   T <seconds> <nanoseconds>\n			set time
+ *
+ * Writers hold an exclusive lock on the log, waiting for up to
+ * dblog_lock_wait seconds for it, and add each batch with a single write.
+ * Readers only use complete batches, so they always see the database as
+ * some writer left it.  While a process has a writer open, opening the
+ * same database again in that process shares it, so a caller that keeps
+ * a writer open across several steps (as mandb does for each hierarchy)
+ * gets all their changes written as one batch.
+ *
+ * A handle that creates a new database keeps the same kind of overlay in
+ * memory, with no log, and writes it to the database in key order when it
+ * is closed.  dbstore() often rewrites an entry several times while
+ * sorting out pages that share a name, and this way only the final
+ * version reaches the database, in a single sequential pass.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h> /* for flock() */
+#include <time.h>
+
+#include "stat-time.h"
+#include "timespec.h"
+#include "xvasprintf.h"
+
+#include "gettext.h"
+#define _(String) gettext (String)
+
+#include "manconfig.h"
+
+#include "error.h"
+#include "hashtable.h"
+
+#include "mydbm.h"
+#include "db_storage.h"
+
+#define LOG_MAGIC	"man-db database log 1\n"
+
+/* Only fold the log into a new database once it has reached this size
+ * and a quarter of the size of the database, so that the cost of
+ * rewriting the database is spread over many updates.
+ */
+#define COMPACT_MIN	(64 * 1024)
+#define COMPACT_RATIO	4
+
+/* Write out what a handle creating a new database has buffered whenever
+ * it reaches this size, to bound its memory use.
+ */
+#define BULK_MAX	(32 * 1024 * 1024)
+
+struct dblog_entry {
+	datum key;
+	datum content;		/* MYDBM_DPTR is NULL if deleted */
+	datum orig;		/* content before this handle changed it */
+	int dirty;
+};
+
+struct dblog {
+	char *name;
+	int fd;			/* locked, if writing; otherwise -1 */
+	off_t size;		/* length of the complete part of the log */
+	off_t header_len;
+	struct hashtable *entries;
+	size_t num_entries;
+	struct timespec time;
+	int have_time, time_dirty;
+	int users;		/* handles sharing this writer */
+	int bulk;		/* creating a new database */
+	int spilled;		/* bulk entries already written out */
+	size_t bulk_size;
+	datum *snapshot;	/* sorted merged keys, while iterating */
+	size_t snapshot_len, snapshot_max, cursor;
+};
+
+struct buffer {
+	char *data;
+	size_t len, max;
+};
+
+static datum empty_datum (void)
+{
+	datum dat;
+
+	memset (&dat, 0, sizeof dat);
+	return dat;
+}
+
+static datum make_datum (const char *data, size_t len)
+{
+	datum dat = empty_datum ();
+
+	MYDBM_SET_DPTR (dat, (char *) data);
+	MYDBM_DSIZE (dat) = len;
+	return copy_datum (dat);
+}
+
+static int same_datum (datum a, datum b)
+{
+	if (!MYDBM_DPTR (a) || !MYDBM_DPTR (b))
+		return !MYDBM_DPTR (a) && !MYDBM_DPTR (b);
+	return MYDBM_DSIZE (a) == MYDBM_DSIZE (b) &&
+	       !memcmp (MYDBM_DPTR (a), MYDBM_DPTR (b), MYDBM_DSIZE (a));
+}
+
+static void entry_free (void *defn)
+{
+	struct dblog_entry *entry = defn;
+
+	MYDBM_FREE_DPTR (entry->key);
+	MYDBM_FREE_DPTR (entry->content);
+	MYDBM_FREE_DPTR (entry->orig);
+	free (entry);
+}
+
+static struct dblog *new_log (const char *name, int fd)
+{
+	struct dblog *log = XZALLOC (struct dblog);
+
+	log->name = xstrdup (name);
+	log->fd = fd;
+	log->entries = hashtable_create (&entry_free);
+	return log;
+}
+
+static void free_snapshot (struct dblog *log)
+{
+	size_t i;
+
+	for (i = 0; i < log->snapshot_len; ++i)
+		MYDBM_FREE_DPTR (log->snapshot[i]);
+	free (log->snapshot);
+	log->snapshot = NULL;
+	log->snapshot_len = log->snapshot_max = log->cursor = 0;
+}
+
+/* Closing the descriptor also releases the lock. */
+static void free_log (struct dblog *log)
+{
+	if (!log)
+		return;
+	free_snapshot (log);
+	hashtable_free (log->entries);
+	if (log->fd >= 0)
+		close (log->fd);
+	free (log->name);
+	free (log);
+}
+
+static int writable (MYDBM_FILE dbf)
+{
+	return dbf->log && dbf->log->fd >= 0;
+}
+
+/* Are changes through DBF kept in its overlay, whether or not they end up
+ * in a log?
+ */
+static int buffered (MYDBM_FILE dbf)
+{
+	return writable (dbf) || (dbf->log && dbf->log->bulk);
+}
+
+/* Might the database hold anything that is not in the overlay?  A new
+ * database has nothing in it until its handle spills what it has
+ * buffered.
+ */
+static int base_in_use (MYDBM_FILE dbf)
+{
+	return !dbf->log || !dbf->log->bulk || dbf->log->spilled;
+}
+
+/* Keys are always NUL-terminated strings.  Include the NUL so that no key
+ * is taken for a prefix of another.
+ */
+static struct dblog_entry *lookup (const struct dblog *log, datum key)
+{
+	return hashtable_lookup (log->entries, MYDBM_DPTR (key),
+				 strlen (MYDBM_DPTR (key)) + 1);
+}
+
+static void install (struct dblog *log, struct dblog_entry *entry)
+{
+	hashtable_install (log->entries, MYDBM_DPTR (entry->key),
+			   strlen (MYDBM_DPTR (entry->key)) + 1, entry);
+	++log->num_entries;
+}
+
+char *dblog_name (const char *file)
+{
+	return xasprintf ("%s%s", file, DB_LOG_EXT);
+}
+
+/* Return the header of a log that applies to BASE. */
+static char *base_header (MYDBM_BASE_FILE base)
+{
+	struct stat st;
+	struct timespec mtime;
+
+	if (fstat (MYDBM_BASE_FD (base), &st) < 0)
+		return NULL;
+	mtime = get_stat_mtime (&st);
+	return xasprintf ("%sbase %llu %llu %ld.%09ld\n", LOG_MAGIC,
+			  (unsigned long long) st.st_dev,
+			  (unsigned long long) st.st_ino,
+			  (long) mtime.tv_sec, mtime.tv_nsec);
+}
+
+/* Read all of FD from the current offset, setting *LEN to its length. */
+static char *read_all (int fd, size_t *len)
+{
+	struct stat st;
+	char *buf;
+	size_t got = 0;
+
+	if (fstat (fd, &st) < 0)
+		return NULL;
+	buf = xmalloc (st.st_size + 1);
+	while (got < (size_t) st.st_size) {
+		ssize_t r = read (fd, buf + got, st.st_size - got);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			free (buf);
+			return NULL;
+		}
+		if (r == 0)
+			break;
+		got += r;
+	}
+	buf[got] = '\0';
+	*len = got;
+	return buf;
+}
+
+static int write_all (int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t w = write (fd, buf, len);
+		if (w < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += w;
+		len -= w;
+	}
+	return 0;
+}
+
+/* Parse a decimal number at *P, which must be followed by TERM before
+ * END, and move *P past the terminator.
+ */
+static int parse_number (const char **p, const char *end, char term,
+			 unsigned long *n)
+{
+	const char *s = *p;
+	unsigned long value = 0;
+
+	if (s >= end || *s < '0' || *s > '9')
+		return -1;
+	while (s < end && *s >= '0' && *s <= '9') {
+		if (value > ((unsigned long) -1 - 9) / 10)
+			return -1;
+		value = value * 10 + (*s++ - '0');
+	}
+	if (s >= end || *s != term)
+		return -1;
+	*p = s + 1;
+	*n = value;
+	return 0;
+}
+
+static void replay_change (struct dblog *log, const char *key, size_t key_len,
+			   const char *content, size_t content_len)
+{
+	datum dkey = make_datum (key, key_len);
+	struct dblog_entry *entry = lookup (log, dkey);
+
+	if (entry)
+		MYDBM_FREE_DPTR (dkey);
+	else {
+		entry = XZALLOC (struct dblog_entry);
+		entry->key = dkey;
+		install (log, entry);
+	}
+	MYDBM_FREE_DPTR (entry->content);
+	if (content)
+		entry->content = make_datum (content, content_len);
+}
+
+/* Apply the records between P and END to LOG, or just check that they are
+ * well-formed if LOG is NULL.
+ */
+static int replay_records (struct dblog *log, const char *p, const char *end)
+{
+	while (p < end) {
+		char op = *p++;
+		unsigned long key_len, content_len, sec, nsec;
+
+		if (p >= end || *p++ != ' ')
+			return -1;
+		switch (op) {
+			case 'S':
+				if (parse_number (&p, end, ' ', &key_len) < 0 ||
+				    parse_number (&p, end, '\n',
+						  &content_len) < 0)
+					return -1;
+				if (key_len > (size_t) (end - p) ||
+				    content_len >=
+					(size_t) (end - p) - key_len ||
+				    p[key_len + content_len] != '\n')
+					return -1;
+				if (log)
+					replay_change (log, p, key_len,
+						       p + key_len,
+						       content_len);
+				p += key_len + content_len + 1;
+				break;
+			case 'D':
+				if (parse_number (&p, end, '\n',
+						  &key_len) < 0)
+					return -1;
+				if (key_len >= (size_t) (end - p) ||
+				    p[key_len] != '\n')
+					return -1;
+				if (log)
+					replay_change (log, p, key_len,
+						       NULL, 0);
+				p += key_len + 1;
+				break;
+			case 'T':
+				if (parse_number (&p, end, ' ', &sec) < 0 ||
+				    parse_number (&p, end, '\n', &nsec) < 0 ||
+				    nsec >= 1000000000)
+					return -1;
+				if (log) {
+					log->time.tv_sec = sec;
+					log->time.tv_nsec = nsec;
+					log->have_time = 1;
+				}
+				break;
+			default:
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/* Apply the log in the LEN bytes at BUF to LOG, if its header is HEADER.
+ * Return the length of the part of the log that can be used, which is 0
+ * if it belongs to some other database.
+ */
+static size_t replay (struct dblog *log, const char *buf, size_t len,
+		      const char *header)
+{
+	size_t header_len = strlen (header);
+	const char *p = buf + header_len, *end = buf + len;
+
+	if (len < header_len || memcmp (buf, header, header_len))
+		return 0;
+
+	while (p < end) {
+		const char *body = p + strlen ("batch ");
+		unsigned long body_len;
+
+		/* Anything incomplete is a batch still being written, or
+		 * one whose writer was interrupted.
+		 */
+		if ((size_t) (end - p) < strlen ("batch ") ||
+		    memcmp (p, "batch ", strlen ("batch ")))
+			break;
+		if (parse_number (&body, end, '\n', &body_len) < 0)
+			break;
+		if (body_len > (size_t) (end - body) ||
+		    (size_t) (end - body) - body_len < strlen ("end\n") ||
+		    memcmp (body + body_len, "end\n", strlen ("end\n")))
+			break;
+		if (replay_records (NULL, body, body + body_len) < 0)
+			break;
+		replay_records (log, body, body + body_len);
+		p = body + body_len + strlen ("end\n");
+	}
+
+	return p - buf;
+}
+
+static MYDBM_FILE open_reader (const char *file)
+{
+	char *name = dblog_name (file);
+	char *prev_header = NULL;
+	MYDBM_FILE dbf;
+
+	for (;;) {
+		MYDBM_BASE_FILE base;
+		struct dblog *log;
+		char *header, *buf;
+		size_t len;
+		int fd;
+
+		base = MYDBM_BASE_RDOPEN ((char *) file);
+		if (!base) {
+			dbf = NULL;
+			break;
+		}
+		dbf = XZALLOC (struct mydbm_file);
+		dbf->base = base;
+
+		fd = open (name, O_RDONLY);
+		if (fd < 0)
+			break;
+		buf = read_all (fd, &len);
+		close (fd);
+		header = base_header (base);
+		if (!buf || !header || !len) {
+			free (header);
+			free (buf);
+			break;
+		}
+
+		log = new_log (name, -1);
+		if (replay (log, buf, len, header)) {
+			if (log->num_entries || log->have_time)
+				dbf->log = log;
+			else
+				free_log (log);
+			free (header);
+			free (buf);
+			break;
+		}
+		free_log (log);
+		free (buf);
+
+		/* The log belongs to some other database.  Most likely
+		 * ours was replaced after we opened it, so try again; but
+		 * if we get the same one, the log is left over from
+		 * something that was interrupted.
+		 */
+		if (prev_header && STREQ (prev_header, header)) {
+			free (header);
+			break;
+		}
+		free (prev_header);
+		prev_header = header;
+		dblog_close (dbf);
+	}
+
+	free (prev_header);
+	free (name);
+	return dbf;
+}
+
+/* How many seconds writers wait for another process to finish with the
+ * log before giving up, or -1 to wait for as long as it takes.
+ */
+int dblog_lock_wait = 60;
+
+/* Take the writer's lock on the log open on FD. */
+static int lock_log (int fd, const char *name)
+{
+	int waited;		/* in tenths of a second */
+
+	if (dblog_lock_wait < 0)
+		return flock (fd, LOCK_EX);
+
+	for (waited = 0; flock (fd, LOCK_EX | LOCK_NB) < 0; ++waited) {
+		struct timespec delay;
+
+		if (errno != EWOULDBLOCK || waited >= dblog_lock_wait * 10)
+			return -1;
+		if (!waited)
+			debug ("waiting for another process to finish "
+			       "with %s\n", name);
+		delay.tv_sec = 0;
+		delay.tv_nsec = 100000000;
+		nanosleep (&delay, NULL);
+	}
+	return 0;
+}
+
+static MYDBM_FILE open_writer (const char *file)
+{
+	char *name = dblog_name (file);
+	MYDBM_FILE dbf = NULL;
+	struct stat fd_st, name_st;
+	char *header = NULL, *buf = NULL;
+	size_t len, valid;
+	int fd, saved_errno;
+
+	for (;;) {
+		fd = open (name, O_RDWR | O_CREAT, DBMODE);
+		if (fd < 0)
+			goto fail;
+		if (lock_log (fd, name) < 0 || fstat (fd, &fd_st) < 0)
+			goto fail;
+		/* mandb removes the log once it has folded it into a new
+		 * database, perhaps between our open and our lock.
+		 */
+		if (stat (name, &name_st) == 0 &&
+		    fd_st.st_dev == name_st.st_dev &&
+		    fd_st.st_ino == name_st.st_ino)
+			break;
+		close (fd);
+	}
+
+	dbf = XZALLOC (struct mydbm_file);
+	dbf->base = MYDBM_BASE_RDOPEN ((char *) file);
+	if (!dbf->base) {
+		saved_errno = errno;
+		if (fd_st.st_size == 0)
+			unlink (name);
+		errno = saved_errno;
+		goto fail;
+	}
+	header = base_header (dbf->base);
+	buf = read_all (fd, &len);
+	if (!header || !buf)
+		goto fail;
+
+	dbf->log = new_log (name, fd);
+	valid = replay (dbf->log, buf, len, header);
+	if (!valid) {
+		/* Start a new log for this database. */
+		valid = strlen (header);
+		if (ftruncate (fd, 0) < 0 || lseek (fd, 0, SEEK_SET) < 0 ||
+		    write_all (fd, header, valid) < 0)
+			goto fail;
+	} else if (valid < len && ftruncate (fd, valid) < 0)
+		/* Drop the remains of an interrupted batch. */
+		goto fail;
+	dbf->log->size = valid;
+	dbf->log->header_len = strlen (header);
+
+	free (buf);
+	free (header);
+	free (name);
+	return dbf;
+
+fail:
+	saved_errno = errno;
+	if (dbf) {
+		if (dbf->log)
+			fd = -1; /* closed along with the log */
+		free_log (dbf->log);
+		if (dbf->base)
+			MYDBM_BASE_CLOSE (dbf->base);
+		free (dbf);
+	}
+	if (fd >= 0)
+		close (fd);
+	free (buf);
+	free (header);
+	free (name);
+	errno = saved_errno;
+	return NULL;
+}
+
+/* Set while building a new database that nobody else can see yet, so
+ * that changes go straight to it.
+ */
+int dblog_bypass = 0;
+
+/* The writers open in this process, by database name. */
+static struct hashtable *writers;
+
+/* Return the writer open on FILE in this process, if any, with one more
+ * user.
+ */
+static MYDBM_FILE share_writer (const char *file)
+{
+	MYDBM_FILE dbf;
+
+	if (!writers)
+		return NULL;
+	dbf = hashtable_lookup (writers, file, strlen (file));
+	if (dbf)
+		++dbf->log->users;
+	return dbf;
+}
+
+/* Open FILE with flags as for open(2).  O_RDWR opens it for writing
+ * through the log, unless dblog_bypass is set; O_CREAT opens it directly,
+ * which is only for building a new database, and with O_TRUNC as well
+ * buffers the new contents until they can be written in key order.
+ */
+MYDBM_FILE dblog_open (const char *file, int flags)
+{
+	MYDBM_BASE_FILE base;
+	MYDBM_FILE dbf;
+
+	if (flags & O_CREAT) {
+		if (flags & O_TRUNC)
+			base = MYDBM_BASE_CTRWOPEN ((char *) file);
+		else
+			base = MYDBM_BASE_CRWOPEN ((char *) file);
+	} else if (flags & O_RDWR) {
+		if (dblog_bypass)
+			base = MYDBM_BASE_RWOPEN ((char *) file);
+		else {
+			dbf = share_writer (file);
+			if (dbf)
+				return dbf;
+			dbf = open_writer (file);
+			if (dbf) {
+				if (!writers)
+					writers = hashtable_create
+						(&null_hashtable_free);
+				hashtable_install (writers, file,
+						   strlen (file), dbf);
+				dbf->log->users = 1;
+			}
+			return dbf;
+		}
+	} else {
+		/* Let readers see what a writer in this process has not
+		 * written out yet.
+		 */
+		dbf = share_writer (file);
+		if (dbf)
+			return dbf;
+		return open_reader (file);
+	}
+
+	if (!base)
+		return NULL;
+	dbf = XZALLOC (struct mydbm_file);
+	dbf->base = base;
+	if ((flags & O_CREAT) && (flags & O_TRUNC)) {
+		dbf->log = new_log (file, -1);
+		dbf->log->bulk = 1;
+	}
+	return dbf;
+}
+
+static void buffer_add (struct buffer *buf, const char *data, size_t len)
+{
+	if (buf->len + len > buf->max) {
+		buf->max = (buf->len + len) * 2;
+		buf->data = xrealloc (buf->data, buf->max);
+	}
+	memcpy (buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static void buffer_add_string (struct buffer *buf, char *str)
+{
+	buffer_add (buf, str, strlen (str));
+	free (str);
+}
+
+/* Append everything changed through this handle to the log. */
+static void write_batch (struct dblog *log)
+{
+	struct buffer body = { NULL, 0, 0 }, batch = { NULL, 0, 0 };
+	struct hashtable_iter *iter = NULL;
+	const struct nlist *np;
+
+	while ((np = hashtable_iterate (log->entries, &iter)) != NULL) {
+		const struct dblog_entry *entry = np->defn;
+
+		/* Rebuilding the section index, for instance, writes back
+		 * much of what was already there.
+		 */
+		if (!entry->dirty || same_datum (entry->content, entry->orig))
+			continue;
+		if (MYDBM_DPTR (entry->content)) {
+			buffer_add_string (&body, xasprintf
+				("S %lu %lu\n",
+				 (unsigned long) MYDBM_DSIZE (entry->key),
+				 (unsigned long) MYDBM_DSIZE (entry->content)));
+			buffer_add (&body, MYDBM_DPTR (entry->key),
+				    MYDBM_DSIZE (entry->key));
+			buffer_add (&body, MYDBM_DPTR (entry->content),
+				    MYDBM_DSIZE (entry->content));
+		} else {
+			buffer_add_string (&body, xasprintf
+				("D %lu\n",
+				 (unsigned long) MYDBM_DSIZE (entry->key)));
+			buffer_add (&body, MYDBM_DPTR (entry->key),
+				    MYDBM_DSIZE (entry->key));
+		}
+		buffer_add (&body, "\n", 1);
+	}
+	if (log->time_dirty)
+		buffer_add_string (&body, xasprintf ("T %ld %ld\n",
+						     (long) log->time.tv_sec,
+						     log->time.tv_nsec));
+	if (!body.len)
+		return;
+
+	buffer_add_string (&batch, xasprintf ("batch %lu\n",
+					      (unsigned long) body.len));
+	buffer_add (&batch, body.data, body.len);
+	buffer_add (&batch, "end\n", strlen ("end\n"));
+
+	/* Readers ignore a batch that is cut short, and the next writer
+	 * truncates it.
+	 */
+	if (lseek (log->fd, log->size, SEEK_SET) < 0 ||
+	    write_all (log->fd, batch.data, batch.len) < 0)
+		error (0, errno, _("can't write to %s"), log->name);
+	else
+		log->size += batch.len;
+
+	free (batch.data);
+	free (body.data);
+}
+
+static int compare_entries (const void *a, const void *b)
+{
+	const struct dblog_entry *left = *(const struct dblog_entry **) a;
+	const struct dblog_entry *right = *(const struct dblog_entry **) b;
+
+	return strcmp (MYDBM_DPTR (left->key), MYDBM_DPTR (right->key));
+}
+
+/* Write what a handle creating a new database has buffered to it in key
+ * order, which lets Berkeley DB fill each B-tree page in turn rather than
+ * splitting pages all over the tree, and start buffering afresh.
+ */
+static void bulk_flush (MYDBM_FILE dbf)
+{
+	struct dblog *log = dbf->log;
+	struct hashtable_iter *iter = NULL;
+	const struct nlist *np;
+	struct dblog_entry **entries;
+	size_t num_entries = 0, i;
+
+	if (!log->num_entries)
+		return;
+
+	entries = XNMALLOC (log->num_entries, struct dblog_entry *);
+	while ((np = hashtable_iterate (log->entries, &iter)) != NULL)
+		entries[num_entries++] = np->defn;
+	qsort (entries, num_entries, sizeof *entries, &compare_entries);
+
+	for (i = 0; i < num_entries; ++i) {
+		const struct dblog_entry *entry = entries[i];
+
+		if (MYDBM_DPTR (entry->content)) {
+			if (MYDBM_BASE_REPLACE (dbf->base, entry->key,
+						entry->content))
+				gripe_replace_key (MYDBM_DPTR (entry->key));
+		} else if (log->spilled)
+			MYDBM_BASE_DELETE (dbf->base, entry->key);
+	}
+	free (entries);
+
+	hashtable_free (log->entries);
+	log->entries = hashtable_create (&entry_free);
+	log->num_entries = 0;
+	log->bulk_size = 0;
+	log->spilled = 1;
+}
+
+void dblog_close (MYDBM_FILE dbf)
+{
+	if (!dbf)
+		return;
+	if (dbf->log && dbf->log->bulk)
+		bulk_flush (dbf);
+	else if (writable (dbf)) {
+		if (--dbf->log->users > 0)
+			return;
+		hashtable_remove (writers, dbf->log->name,
+				  strlen (dbf->log->name) -
+				  strlen (DB_LOG_EXT));
+		write_batch (dbf->log);
+		/* Don't leave an empty log behind.  We still hold the lock,
+		 * and writers check that the log they locked is still in
+		 * place.
+		 */
+		if (dbf->log->size == dbf->log->header_len)
+			unlink (dbf->log->name);
+	}
+	free_log (dbf->log);
+	MYDBM_BASE_CLOSE (dbf->base);
+	free (dbf);
+}
+
+datum dblog_fetch (MYDBM_FILE dbf, datum key)
+{
+	if (dbf->log) {
+		const struct dblog_entry *entry = lookup (dbf->log, key);
+		if (entry)
+			return MYDBM_DPTR (entry->content)
+				? copy_datum (entry->content)
+				: empty_datum ();
+	}
+	if (!base_in_use (dbf))
+		return empty_datum ();
+	return MYDBM_BASE_FETCH (dbf->base, key);
+}
+
+int dblog_exists (MYDBM_FILE dbf, datum key)
+{
+	if (dbf->log) {
+		const struct dblog_entry *entry = lookup (dbf->log, key);
+		if (entry)
+			return MYDBM_DPTR (entry->content) != NULL;
+	}
+	if (!base_in_use (dbf))
+		return 0;
+	return MYDBM_BASE_EXISTS (dbf->base, key);
+}
+
+/* Return the entry for KEY, ready for this handle to change it. */
+static struct dblog_entry *change_entry (MYDBM_FILE dbf, datum key)
+{
+	struct dblog_entry *entry = lookup (dbf->log, key);
+
+	if (!entry) {
+		entry = XZALLOC (struct dblog_entry);
+		entry->key = copy_datum (key);
+		entry->content = base_in_use (dbf)
+			? MYDBM_BASE_FETCH (dbf->base, key)
+			: empty_datum ();
+		install (dbf->log, entry);
+	}
+	if (!entry->dirty) {
+		entry->orig = entry->content;
+		entry->content = empty_datum ();
+		entry->dirty = 1;
+	} else
+		MYDBM_FREE_DPTR (entry->content);
+	return entry;
+}
+
+int dblog_replace (MYDBM_FILE dbf, datum key, datum cont)
+{
+	struct dblog_entry *entry;
+
+	if (!buffered (dbf))
+		return MYDBM_BASE_REPLACE (dbf->base, key, cont);
+
+	entry = change_entry (dbf, key);
+	entry->content = copy_datum (cont);
+	if (dbf->log->bulk) {
+		dbf->log->bulk_size += MYDBM_DSIZE (key) + MYDBM_DSIZE (cont);
+		if (dbf->log->bulk_size >= BULK_MAX)
+			bulk_flush (dbf);
+	}
+	return 0;
+}
+
+int dblog_insert (MYDBM_FILE dbf, datum key, datum cont)
+{
+	if (!buffered (dbf))
+		return MYDBM_BASE_INSERT (dbf->base, key, cont);
+
+	if (dblog_exists (dbf, key))
+		return 1;
+	return dblog_replace (dbf, key, cont);
+}
+
+int dblog_delete (MYDBM_FILE dbf, datum key)
+{
+	if (!buffered (dbf))
+		return MYDBM_BASE_DELETE (dbf->base, key);
+
+	if (!dblog_exists (dbf, key))
+		return -1;
+	change_entry (dbf, key);
+	return 0;
+}
+
+static int compare_keys (const void *a, const void *b)
+{
+	const datum *left = a, *right = b;
+
+	return strcmp (MYDBM_DPTR (*left), MYDBM_DPTR (*right));
+}
+
+static void snapshot_add (struct dblog *log, datum key)
+{
+	if (log->snapshot_len >= log->snapshot_max) {
+		log->snapshot_max *= 2;
+		log->snapshot = xnrealloc (log->snapshot, log->snapshot_max,
+					   sizeof *log->snapshot);
+	}
+	log->snapshot[log->snapshot_len++] = key;
+}
+
+/* Take a sorted list of the keys in the database with the log applied, to
+ * iterate over.
+ */
+static void take_snapshot (MYDBM_FILE dbf)
+{
+	struct dblog *log = dbf->log;
+	struct hashtable_iter *iter = NULL;
+	const struct nlist *np;
+	datum key;
+
+	free_snapshot (log);
+	log->snapshot_max = 256;
+	log->snapshot = XNMALLOC (log->snapshot_max, datum);
+
+	key = MYDBM_BASE_FIRSTKEY (dbf->base);
+	while (MYDBM_DPTR (key)) {
+		datum nextkey = MYDBM_BASE_NEXTKEY (dbf->base, key);
+
+		if (lookup (log, key))
+			MYDBM_FREE_DPTR (key);
+		else
+			snapshot_add (log, key);
+		key = nextkey;
+	}
+
+	while ((np = hashtable_iterate (log->entries, &iter)) != NULL) {
+		const struct dblog_entry *entry = np->defn;
+
+		if (MYDBM_DPTR (entry->content))
+			snapshot_add (log, copy_datum (entry->key));
+	}
+
+	qsort (log->snapshot, log->snapshot_len, sizeof *log->snapshot,
+	       &compare_keys);
+	log->cursor = 0;
+}
+
+static datum snapshot_key (const struct dblog *log)
+{
+	if (log->cursor >= log->snapshot_len)
+		return empty_datum ();
+	return copy_datum (log->snapshot[log->cursor]);
+}
+
+datum dblog_firstkey (MYDBM_FILE dbf)
+{
+	if (!dbf->log || !dbf->log->num_entries) {
+		if (dbf->log)
+			free_snapshot (dbf->log);
+		return MYDBM_BASE_FIRSTKEY (dbf->base);
+	}
+
+	take_snapshot (dbf);
+	return snapshot_key (dbf->log);
+}
+
+datum dblog_nextkey (MYDBM_FILE dbf, datum key)
+{
+	struct dblog *log = dbf->log;
+
+	if (!log || !log->snapshot)
+		return MYDBM_BASE_NEXTKEY (dbf->base, key);
+
+	if (log->cursor < log->snapshot_len &&
+	    STREQ (MYDBM_DPTR (log->snapshot[log->cursor]), MYDBM_DPTR (key)))
+		++log->cursor;
+	else {
+		/* Find the first key after KEY. */
+		size_t lo = 0, hi = log->snapshot_len;
+
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (strcmp (MYDBM_DPTR (log->snapshot[mid]),
+				    MYDBM_DPTR (key)) <= 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		log->cursor = lo;
+	}
+	return snapshot_key (log);
+}
+
+#ifdef BTREE
+int dblog_nextkeydata (MYDBM_FILE dbf, datum *key, datum *cont)
+{
+	struct dblog *log = dbf->log;
+
+	if (!log || !log->num_entries)
+		return btree_nextkeydata (dbf->base, key, cont);
+
+	if (log->snapshot)
+		++log->cursor;
+	else
+		take_snapshot (dbf);
+	if (log->cursor >= log->snapshot_len)
+		return 1;
+	*key = snapshot_key (log);
+	*cont = dblog_fetch (dbf, *key);
+	return 0;
+}
+#endif /* BTREE */
+
+struct timespec dblog_get_time (MYDBM_FILE dbf)
+{
+	if (dbf->log && dbf->log->have_time)
+		return dbf->log->time;
+	return MYDBM_BASE_GET_TIME (dbf->base);
+}
+
+void dblog_set_time (MYDBM_FILE dbf, const struct timespec time)
+{
+	struct dblog *log = dbf->log;
+
+	if (!writable (dbf)) {
+		/* Writing out buffered changes later would change the
+		 * database's modification time again.
+		 */
+		if (log && log->bulk)
+			bulk_flush (dbf);
+		MYDBM_BASE_SET_TIME (dbf->base, time);
+		return;
+	}
+
+	if (time.tv_nsec == UTIME_OMIT)
+		return;
+	else if (time.tv_nsec == UTIME_NOW) {
+		/* Use the file system's idea of the current time, as the
+		 * database's own modification time would have done.
+		 */
+		struct timespec times[2];
+		struct stat st;
+
+		times[0] = times[1] = time;
+		if (futimens (log->fd, times) < 0 || fstat (log->fd, &st) < 0)
+			return;
+		log->time = get_stat_mtime (&st);
+	} else
+		log->time = time;
+	log->have_time = log->time_dirty = 1;
+}
+
+void dblog_reorg (MYDBM_FILE dbf)
+{
+	/* The database itself does not change while it is written through
+	 * the log.
+	 */
+	if (writable (dbf))
+		return;
+	if (dbf->log && dbf->log->bulk)
+		bulk_flush (dbf);
+	MYDBM_BASE_REORG (dbf->base);
+}
+
+/* Is it time to fold the log of DBF, opened for writing, into a new
+ * database?
+ */
+int dblog_wants_compaction (MYDBM_FILE dbf)
+{
+	struct stat st;
+
+	if (!writable (dbf) || dbf->log->size < COMPACT_MIN)
+		return 0;
+	if (fstat (MYDBM_BASE_FD (dbf->base), &st) < 0)
+		return 1;
+	return dbf->log->size * COMPACT_RATIO >= st.st_size;
+}
+
+/* Write the contents of DBF, with its log applied, to a new database
+ * NEWFILE.  If DBF was opened for writing, nobody else can change it until
+ * it is closed, which gives the caller a chance to put the new database in
+ * place of the old one and remove the log.
+ */
+int dblog_compact (MYDBM_FILE dbf, const char *newfile)
+{
+	MYDBM_BASE_FILE new_base;
+	struct timespec time = dblog_get_time (dbf);
+	datum key;
+
+	new_base = MYDBM_BASE_CTRWOPEN ((char *) newfile);
+	if (!new_base)
+		return -1;
+
+	key = dblog_firstkey (dbf);
+	while (MYDBM_DPTR (key)) {
+		datum content, nextkey;
+
+		content = dblog_fetch (dbf, key);
+		if (MYDBM_DPTR (content)) {
+			int ret = MYDBM_BASE_REPLACE (new_base, key, content);
+			MYDBM_FREE_DPTR (content);
+			if (ret) {
+				MYDBM_FREE_DPTR (key);
+				MYDBM_BASE_CLOSE (new_base);
+				return -1;
+			}
+		}
+		nextkey = dblog_nextkey (dbf, key);
+		MYDBM_FREE_DPTR (key);
+		key = nextkey;
+	}
+	MYDBM_BASE_CLOSE (new_base);
+
+	/* Closing the database may write to it, so set its modification
+	 * time separately.
+	 */
+	new_base = MYDBM_BASE_RWOPEN ((char *) newfile);
+	if (!new_base)
+		return -1;
+	MYDBM_BASE_SET_TIME (new_base, time);
+	MYDBM_BASE_CLOSE (new_base);
+
+	return 0;
+}
+
+/* Remove the log of FILE, once it has been replaced by a new database. */
+void dblog_remove (const char *file)
+{
+	char *name = dblog_name (file);
+
+	if (unlink (name) < 0 && errno != ENOENT)
+		error (0, errno, _("can't remove %s"), name);
+	free (name);
+}
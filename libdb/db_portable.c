@@ -0,0 +1,291 @@
+/*
+ * db_portable.c: reproducible, architecture-independent database copies
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * The on-disk layout of the database depends on the backend, the host's
+ * byte order, and the order in which keys were inserted, so two identical
+ * systems will not in general produce identical databases.  A portable
+ * database holds the same information in a form that depends only on the
+ * contents of the manual page hierarchy, so that it can be built once and
+ * shipped to many systems.
+ *
+ * The file starts with the following newline-terminated header lines:
+ *
+ *   man-db portable index 1
+ *   version <database version identifier>
+ *   manifest <digest of the hierarchy's contents; see manifest_digest()>
+ *
+ * followed by an empty line and then each key and its content as
+ * NUL-terminated strings, sorted by key.  Special keys (starting with '$')
+ * are omitted, and the parts of multiple-entry contents are sorted, so
+ * the result does not depend on insertion order.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "xvasprintf.h"
+
+#include "gettext.h"
+#define _(String) gettext (String)
+
+#include "manconfig.h"
+
+#include "error.h"
+
+#include "mydbm.h"
+#include "db_storage.h"
+
+#define PORTABLE_HEADER "man-db portable index 1"
+
+struct portable_record {
+	char *key;
+	char *cont;
+};
+
+static int compare_records (const void *a, const void *b)
+{
+	const struct portable_record *left = a;
+	const struct portable_record *right = b;
+	return strcmp (left->key, right->key);
+}
+
+static int compare_strings (const void *a, const void *b)
+{
+	const char *left = *(const char **) a;
+	const char *right = *(const char **) b;
+	return strcmp (left, right);
+}
+
+/* Multiple-entry contents are a list of "\tname\text" pairs in the order
+ * in which the entries were added.  Return a copy with the pairs sorted.
+ */
+static char *normalise_multi (const char *cont)
+{
+	char *copy = xstrdup (cont + 1);
+	char **pairs = NULL;
+	size_t pairs_len = 0, i;
+	char *p, *normalised = NULL;
+
+	for (p = copy; p; ) {
+		char *ext = strchr (p, '\t');
+		char *next;
+
+		if (!ext)
+			break;
+		next = strchr (ext + 1, '\t');
+		if (next)
+			*next++ = '\0';
+		pairs = xnrealloc (pairs, pairs_len + 1, sizeof *pairs);
+		pairs[pairs_len++] = p;
+		p = next;
+	}
+
+	qsort (pairs, pairs_len, sizeof *pairs, &compare_strings);
+	normalised = xstrdup ("");
+	for (i = 0; i < pairs_len; ++i)
+		normalised = appendstr (normalised, "\t", pairs[i], NULL);
+
+	free (pairs);
+	free (copy);
+	return normalised;
+}
+
+/* Write the contents of DBFILE to FILE in portable form, recording that
+ * it describes a hierarchy whose contents have the given DIGEST.  FILE is
+ * replaced atomically.  Returns 0 on success, or -1 with errno set on
+ * failure.
+ */
+int dbportable_wr (MYDBM_FILE dbfile, const char *file, const char *digest)
+{
+	struct portable_record *records = NULL;
+	size_t records_len = 0, records_max = 0, i;
+	datum key;
+	char *tmpfile;
+	FILE *fp;
+	int ret = 0, saved_errno;
+
+	key = MYDBM_FIRSTKEY (dbfile);
+	while (MYDBM_DPTR (key) != NULL) {
+		datum content, nextkey;
+
+		if (*MYDBM_DPTR (key) == '$')
+			goto next;
+		content = MYDBM_FETCH (dbfile, key);
+		if (!MYDBM_DPTR (content))
+			goto next;
+
+		if (records_len >= records_max) {
+			records_max = records_max ? records_max * 2 : 1024;
+			records = xnrealloc (records, records_max,
+					     sizeof *records);
+		}
+		records[records_len].key = xstrdup (MYDBM_DPTR (key));
+		if (*MYDBM_DPTR (content) == '\t')
+			records[records_len].cont =
+				normalise_multi (MYDBM_DPTR (content));
+		else
+			records[records_len].cont =
+				xstrdup (MYDBM_DPTR (content));
+		++records_len;
+		MYDBM_FREE_DPTR (content);
+
+next:
+		nextkey = MYDBM_NEXTKEY (dbfile, key);
+		MYDBM_FREE_DPTR (key);
+		key = nextkey;
+	}
+
+	qsort (records, records_len, sizeof *records, &compare_records);
+
+	tmpfile = xasprintf ("%s.tmp", file);
+	fp = fopen (tmpfile, "w");
+	if (!fp) {
+		ret = -1;
+		goto out;
+	}
+	fprintf (fp, "%s\nversion %s\nmanifest %s\n\n",
+		 PORTABLE_HEADER, VER_ID, digest);
+	for (i = 0; i < records_len; ++i) {
+		fwrite (records[i].key, 1, strlen (records[i].key) + 1, fp);
+		fwrite (records[i].cont, 1, strlen (records[i].cont) + 1, fp);
+	}
+	if (ferror (fp) || fclose (fp) != 0 || rename (tmpfile, file) < 0) {
+		saved_errno = errno;
+		unlink (tmpfile);
+		errno = saved_errno;
+		ret = -1;
+	}
+
+out:
+	saved_errno = errno;
+	for (i = 0; i < records_len; ++i) {
+		free (records[i].key);
+		free (records[i].cont);
+	}
+	free (records);
+	free (tmpfile);
+	errno = saved_errno;
+	return ret;
+}
+
+/* Read one header line of the form "NAME VALUE" and check that VALUE is
+ * as expected.
+ */
+static int check_header (FILE *fp, const char *name, const char *value,
+			 char **line, size_t *n)
+{
+	ssize_t len = getline (line, n, fp);
+	size_t name_len = strlen (name);
+
+	if (len < 0)
+		return 0;
+	if ((*line)[len - 1] == '\n')
+		(*line)[len - 1] = '\0';
+	if (!STRNEQ (*line, name, name_len) || (*line)[name_len] != ' ') {
+		debug ("portable database has no %s header\n", name);
+		return 0;
+	}
+	if (!STREQ (*line + name_len + 1, value)) {
+		debug ("portable database has %s %s, expecting %s\n",
+		       name, *line + name_len + 1, value);
+		return 0;
+	}
+	return 1;
+}
+
+/* Load the portable database in FILE into the newly-created DBFILE, as
+ * long as it is for this database version and describes a hierarchy whose
+ * contents have the given DIGEST.  Returns the number of keys loaded, or
+ * -1 if FILE cannot be used (in which case the caller should create
+ * DBFILE afresh in the usual way).
+ */
+int dbportable_rd (MYDBM_FILE dbfile, const char *file, const char *digest)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t n = 0;
+	int count = -1;
+
+	fp = fopen (file, "r");
+	if (!fp)
+		return -1;
+
+	if (getline (&line, &n, fp) < 0 ||
+	    !STREQ (line, PORTABLE_HEADER "\n")) {
+		debug ("%s is not a portable database\n", file);
+		goto out;
+	}
+	if (!check_header (fp, "version", VER_ID, &line, &n) ||
+	    !check_header (fp, "manifest", digest, &line, &n))
+		goto out;
+	if (getline (&line, &n, fp) < 0 || !STREQ (line, "\n"))
+		goto out;
+
+	dbver_wr (dbfile);
+	count = 0;
+	for (;;) {
+		datum key, content;
+		ssize_t len;
+
+		memset (&key, 0, sizeof key);
+		memset (&content, 0, sizeof content);
+
+		len = getdelim (&line, &n, '\0', fp);
+		if (len < 0)
+			break;
+		if (line[len - 1] != '\0')
+			goto truncated;
+		MYDBM_SET (key, xstrdup (line));
+		len = getdelim (&line, &n, '\0', fp);
+		if (len < 0 || line[len - 1] != '\0') {
+			MYDBM_FREE_DPTR (key);
+			goto truncated;
+		}
+		MYDBM_SET (content, xstrdup (line));
+
+		if (MYDBM_REPLACE (dbfile, key, content) != 0)
+			gripe_replace_key (MYDBM_DPTR (key));
+		else
+			++count;
+
+		MYDBM_FREE_DPTR (key);
+		MYDBM_FREE_DPTR (content);
+	}
+
+	debug ("loaded %d keys from portable database %s\n", count, file);
+	goto out;
+
+truncated:
+	error (0, 0, _("%s: truncated portable database"), file);
+	count = -1;
+
+out:
+	free (line);
+	fclose (fp);
+	return count;
+}
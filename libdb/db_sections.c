@@ -0,0 +1,340 @@
+/*
+ * db_sections.c: per-section secondary index of the database
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Programs that only care about some sections (catman, apropos -s) would
+ * otherwise have to fetch and split every record in the database.  mandb
+ * therefore records, for each section and each extension, the keys of the
+ * real page entries with that section or extension.
+ *
+ * The list for SECTION is stored under the keys "$sec$SECTION$0",
+ * "$sec$SECTION$1", and so on, each holding newline-separated database
+ * keys in sorted order; it is split up like this to keep within the ndbm
+ * record size limit.  The key "$sections$" lists the indexed sections, and
+ * is only present while the index is complete.  Entries may be deleted
+ * from the database without updating the index, so callers must still
+ * check each entry they look up.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "xvasprintf.h"
+
+#include "manconfig.h"
+
+#include "error.h"
+#include "hashtable.h"
+
+#include "mydbm.h"
+#include "db_storage.h"
+
+#define SECTIONS_KEY	"$sections$"
+#define SECTION_PREFIX	"$sec$"
+#define CHUNK_MAX	4000
+
+struct section_list {
+	char **keys;
+	size_t len, max;
+	int chunks;		/* number of chunks stored */
+};
+
+static void section_list_free (void *defn)
+{
+	struct section_list *list = defn;
+	size_t i;
+
+	for (i = 0; i < list->len; ++i)
+		free (list->keys[i]);
+	free (list->keys);
+	free (list);
+}
+
+static void add_key (struct hashtable *lists, const char *section,
+		     const char *key)
+{
+	struct section_list *list;
+
+	/* Include the terminating NUL so that "1" does not match "1ssl". */
+	list = hashtable_lookup (lists, section, strlen (section) + 1);
+	if (!list) {
+		list = XZALLOC (struct section_list);
+		hashtable_install (lists, section, strlen (section) + 1, list);
+	}
+
+	if (list->len >= list->max) {
+		list->max = list->max ? list->max * 2 : 16;
+		list->keys = xnrealloc (list->keys, list->max,
+					sizeof *list->keys);
+	}
+	list->keys[list->len++] = xstrdup (key);
+}
+
+static int compare_strings (const void *a, const void *b)
+{
+	return strcmp (*(const char **) a, *(const char **) b);
+}
+
+/* Store VALUE under NAME, unless it is already there. */
+static void store_string (MYDBM_FILE dbf, const char *name, const char *value)
+{
+	datum key, cont;
+
+	memset (&key, 0, sizeof key);
+	memset (&cont, 0, sizeof cont);
+	MYDBM_SET (key, xstrdup (name));
+	cont = MYDBM_FETCH (dbf, key);
+	if (!MYDBM_DPTR (cont) || !STREQ (MYDBM_DPTR (cont), value)) {
+		MYDBM_FREE_DPTR (cont);
+		MYDBM_SET (cont, xstrdup (value));
+		if (MYDBM_REPLACE (dbf, key, cont))
+			gripe_replace_key (MYDBM_DPTR (key));
+	}
+	MYDBM_FREE_DPTR (key);
+	MYDBM_FREE_DPTR (cont);
+}
+
+static void delete_string (MYDBM_FILE dbf, const char *name)
+{
+	datum key;
+
+	memset (&key, 0, sizeof key);
+	MYDBM_SET (key, xstrdup (name));
+	MYDBM_DELETE (dbf, key);
+	MYDBM_FREE_DPTR (key);
+}
+
+/* Store the list of keys for one section, in chunks.  The keys are sorted
+ * first, so that the chunks do not depend on the order in which the
+ * database happens to return its keys, and adding a page only changes the
+ * chunks around it.
+ */
+static void store_section (MYDBM_FILE dbf, const char *section,
+			   struct section_list *list)
+{
+	char *chunk = NULL;
+	size_t chunk_len = 0, i;
+
+	qsort (list->keys, list->len, sizeof *list->keys, &compare_strings);
+
+	list->chunks = 0;
+	for (i = 0; i <= list->len; ++i) {
+		size_t key_len = i < list->len ? strlen (list->keys[i]) : 0;
+
+		/* Break after the last complete key. */
+		if (chunk_len && (i == list->len ||
+				  chunk_len + key_len + 1 > CHUNK_MAX)) {
+			char *name = xasprintf ("%s%s$%d", SECTION_PREFIX,
+						section, list->chunks++);
+			store_string (dbf, name, chunk);
+			free (name);
+			chunk_len = 0;
+		}
+		if (i == list->len)
+			break;
+		chunk = xrealloc (chunk, chunk_len + key_len + 2);
+		memcpy (chunk + chunk_len, list->keys[i], key_len);
+		chunk_len += key_len;
+		chunk[chunk_len++] = '\n';
+		chunk[chunk_len] = '\0';
+	}
+	free (chunk);
+}
+
+/* Is the chunk of the section index called NAME still in use after
+ * storing LISTS?
+ */
+static int chunk_in_use (struct hashtable *lists, const char *name)
+{
+	const char *section = name + sizeof SECTION_PREFIX - 1;
+	const char *dollar = strrchr (section, '$');
+	const struct section_list *list;
+	char *section_name;
+
+	if (!dollar)
+		return 0;
+	section_name = xstrndup (section, dollar - section);
+	list = hashtable_lookup (lists, section_name,
+				 strlen (section_name) + 1);
+	free (section_name);
+	return list && atoi (dollar + 1) < list->chunks;
+}
+
+/* Bring the section index of DBF up to date.  Only chunks whose contents
+ * change are written.
+ */
+void dbsections_build (MYDBM_FILE dbf)
+{
+	struct hashtable *lists = hashtable_create (&section_list_free);
+	struct hashtable_iter *iter = NULL;
+	const struct nlist *np;
+	char **old = NULL, **names = NULL;
+	size_t old_len = 0, names_len = 0, i;
+	char *sections = xstrdup ("");
+	datum key;
+
+	key = MYDBM_FIRSTKEY (dbf);
+	while (MYDBM_DPTR (key) != NULL) {
+		datum content, nextkey;
+		struct mandata entry;
+
+		if (*MYDBM_DPTR (key) == '$') {
+			if (STRNEQ (MYDBM_DPTR (key), SECTION_PREFIX,
+				    sizeof SECTION_PREFIX - 1)) {
+				old = xnrealloc (old, old_len + 1,
+						 sizeof *old);
+				old[old_len++] = xstrdup (MYDBM_DPTR (key));
+			}
+			goto next;
+		}
+
+		content = MYDBM_FETCH (dbf, key);
+		if (!MYDBM_DPTR (content))
+			goto next;
+		/* Only real entries, not the lists of multiple entries. */
+		if (*MYDBM_DPTR (content) != '\t') {
+			split_content (MYDBM_DPTR (content), &entry);
+			add_key (lists, entry.sec, MYDBM_DPTR (key));
+			if (!STREQ (entry.ext, entry.sec))
+				add_key (lists, entry.ext, MYDBM_DPTR (key));
+			entry.addr = NULL; /* == MYDBM_DPTR (content) */
+			free_mandata_elements (&entry);
+		}
+		MYDBM_FREE_DPTR (content);
+
+next:
+		nextkey = MYDBM_NEXTKEY (dbf, key);
+		MYDBM_FREE_DPTR (key);
+		key = nextkey;
+	}
+
+	while ((np = hashtable_iterate (lists, &iter)) != NULL) {
+		names = xnrealloc (names, names_len + 1, sizeof *names);
+		names[names_len++] = np->name;
+	}
+	qsort (names, names_len, sizeof *names, &compare_strings);
+	for (i = 0; i < names_len; ++i) {
+		store_section (dbf, names[i],
+			       hashtable_lookup (lists, names[i],
+						 strlen (names[i]) + 1));
+		sections = appendstr (sections, names[i], "\n", NULL);
+	}
+	free (names);
+
+	for (i = 0; i < old_len; ++i) {
+		if (!chunk_in_use (lists, old[i]))
+			delete_string (dbf, old[i]);
+		free (old[i]);
+	}
+	free (old);
+
+	store_string (dbf, SECTIONS_KEY, sections);
+	debug ("dbsections_build: indexed sections:\n%s", sections);
+
+	free (sections);
+	hashtable_free (lists);
+}
+
+/* Does DBF have a complete section index? */
+int dbsections_exist (MYDBM_FILE dbf)
+{
+	datum key, content;
+	int exist;
+
+	memset (&key, 0, sizeof key);
+	MYDBM_SET (key, xstrdup (SECTIONS_KEY));
+	content = MYDBM_FETCH (dbf, key);
+	MYDBM_FREE_DPTR (key);
+	exist = MYDBM_DPTR (content) != NULL;
+	MYDBM_FREE_DPTR (content);
+	return exist;
+}
+
+/* Mark the section index of DBF as incomplete, because entries may have
+ * been added without updating it.  The next run of mandb rebuilds it.
+ */
+void dbsections_invalidate (MYDBM_FILE dbf)
+{
+	delete_string (dbf, SECTIONS_KEY);
+}
+
+/* Return a NULL-terminated array of the keys of entries in DBF whose
+ * section or extension is SECTION, or NULL if DBF has no complete section
+ * index.  Some of the keys may no longer exist or may have changed.
+ */
+char **dbsections_lookup (MYDBM_FILE dbf, const char *section)
+{
+	char **keys = NULL;
+	size_t keys_len = 0;
+	datum key, content;
+	int chunk;
+
+	if (!dbsections_exist (dbf))
+		return NULL;
+
+	memset (&key, 0, sizeof key);
+	keys = XNMALLOC (1, char *);
+	for (chunk = 0; ; ++chunk) {
+		char *name, *p;
+
+		name = xasprintf ("%s%s$%d", SECTION_PREFIX, section, chunk);
+		MYDBM_SET (key, name);
+		content = MYDBM_FETCH (dbf, key);
+		MYDBM_FREE_DPTR (key);
+		if (!MYDBM_DPTR (content))
+			break;
+
+		for (p = MYDBM_DPTR (content); *p; ) {
+			char *nl = strchr (p, '\n');
+
+			if (!nl)
+				nl = p + strlen (p);
+			keys = xnrealloc (keys, keys_len + 2, sizeof *keys);
+			keys[keys_len++] = xstrndup (p, nl - p);
+			p = *nl ? nl + 1 : nl;
+		}
+		MYDBM_FREE_DPTR (content);
+	}
+	keys[keys_len] = NULL;
+
+	debug ("dbsections_lookup: %zu keys in section %s\n",
+	       keys_len, section);
+	return keys;
+}
+
+/* Return the next key from an array returned by dbsections_lookup(),
+ * taking ownership of it, or a datum with a NULL pointer at the end.
+ */
+datum dbsections_next_key (char ***next)
+{
+	datum key;
+
+	memset (&key, 0, sizeof key);
+	if (**next) {
+		MYDBM_SET (key, **next);
+		++*next;
+	}
+	return key;
+}
@@ -37,6 +37,8 @@
 #ifndef MYDBM_H
 # define MYDBM_H
 
+# include <fcntl.h>
+
 # include "timespec.h"
 
 # if defined(GDBM) && !defined(NDBM) && !defined(BTREE)
@@ -64,29 +66,30 @@ void man_gdbm_close (man_gdbm_wrapper wrap);
 
 #  define BLK_SIZE			0  /* to invoke normal fs block size */
 #  define DB_EXT				".db"
-#  define MYDBM_FILE 			man_gdbm_wrapper
+#  define MYDBM_BASE_FILE 			man_gdbm_wrapper
 #  define MYDBM_DPTR(d)			((d).dptr)
 #  define MYDBM_SET_DPTR(d, value)	((d).dptr = (value))
 #  define MYDBM_DSIZE(d)		((d).dsize)
-#  define MYDBM_CTRWOPEN(file)		\
+#  define MYDBM_BASE_CTRWOPEN(file)		\
 	man_gdbm_open_wrapper(file, GDBM_NEWDB|GDBM_FAST)
-#  define MYDBM_CRWOPEN(file)		\
+#  define MYDBM_BASE_CRWOPEN(file)		\
 	man_gdbm_open_wrapper(file, GDBM_WRCREAT|GDBM_FAST)
-#  define MYDBM_RWOPEN(file)		\
+#  define MYDBM_BASE_RWOPEN(file)		\
 	man_gdbm_open_wrapper(file, GDBM_WRITER|GDBM_FAST)
-#  define MYDBM_RDOPEN(file)		\
+#  define MYDBM_BASE_RDOPEN(file)		\
 	man_gdbm_open_wrapper(file, GDBM_READER)
-#  define MYDBM_INSERT(db, key, cont)	gdbm_store((db)->file, key, cont, GDBM_INSERT)
-#  define MYDBM_REPLACE(db, key, cont) 	gdbm_store((db)->file, key, cont, GDBM_REPLACE)
-#  define MYDBM_EXISTS(db, key)		gdbm_exists((db)->file, key)
-#  define MYDBM_DELETE(db, key)		gdbm_delete((db)->file, key)
-#  define MYDBM_FETCH(db, key)		gdbm_fetch((db)->file, key)
-#  define MYDBM_CLOSE(db)		man_gdbm_close(db)
-#  define MYDBM_FIRSTKEY(db)		man_gdbm_firstkey(db)
-#  define MYDBM_NEXTKEY(db, key)		man_gdbm_nextkey(db, key)
-#  define MYDBM_GET_TIME(db)		man_gdbm_get_time(db)
-#  define MYDBM_SET_TIME(db, time)	man_gdbm_set_time(db, time)
-#  define MYDBM_REORG(db)		gdbm_reorganize((db)->file)
+#  define MYDBM_BASE_INSERT(db, key, cont)	gdbm_store((db)->file, key, cont, GDBM_INSERT)
+#  define MYDBM_BASE_REPLACE(db, key, cont) 	gdbm_store((db)->file, key, cont, GDBM_REPLACE)
+#  define MYDBM_BASE_EXISTS(db, key)		gdbm_exists((db)->file, key)
+#  define MYDBM_BASE_DELETE(db, key)		gdbm_delete((db)->file, key)
+#  define MYDBM_BASE_FETCH(db, key)		gdbm_fetch((db)->file, key)
+#  define MYDBM_BASE_CLOSE(db)		man_gdbm_close(db)
+#  define MYDBM_BASE_FIRSTKEY(db)		man_gdbm_firstkey(db)
+#  define MYDBM_BASE_NEXTKEY(db, key)		man_gdbm_nextkey(db, key)
+#  define MYDBM_BASE_GET_TIME(db)		man_gdbm_get_time(db)
+#  define MYDBM_BASE_SET_TIME(db, time)	man_gdbm_set_time(db, time)
+#  define MYDBM_BASE_REORG(db)		gdbm_reorganize((db)->file)
+#  define MYDBM_BASE_FD(db)		gdbm_fdesc((db)->file)
 
 # elif defined(NDBM) && !defined(GDBM) && !defined(BTREE)
 
@@ -107,25 +110,26 @@ extern void ndbm_set_time(DBM *db, const struct timespec time);
 extern int ndbm_flclose(DBM *db);
 
 #  define DB_EXT				""
-#  define MYDBM_FILE 			DBM*
+#  define MYDBM_BASE_FILE 			DBM*
 #  define MYDBM_DPTR(d)			((d).dptr)
 #  define MYDBM_SET_DPTR(d, value)	((d).dptr = (value))
 #  define MYDBM_DSIZE(d)		((d).dsize)
-#  define MYDBM_CTRWOPEN(file)		ndbm_flopen(file, O_TRUNC|O_CREAT|O_RDWR, DBMODE)
-#  define MYDBM_CRWOPEN(file)             ndbm_flopen(file, O_CREAT|O_RDWR, DBMODE)
-#  define MYDBM_RWOPEN(file)		ndbm_flopen(file, O_RDWR, DBMODE)
-#  define MYDBM_RDOPEN(file)		ndbm_flopen(file, O_RDONLY, DBMODE)
-#  define MYDBM_INSERT(db, key, cont)	dbm_store(db, key, cont, DBM_INSERT)
-#  define MYDBM_REPLACE(db, key, cont)   dbm_store(db, key, cont, DBM_REPLACE)
-#  define MYDBM_EXISTS(db, key)		(dbm_fetch(db, key).dptr != NULL)
-#  define MYDBM_DELETE(db, key)		dbm_delete(db, key)
-#  define MYDBM_FETCH(db, key) 		copy_datum(dbm_fetch(db, key))
-#  define MYDBM_CLOSE(db)		ndbm_flclose(db)
-#  define MYDBM_FIRSTKEY(db)		copy_datum(dbm_firstkey(db))
-#  define MYDBM_NEXTKEY(db, key)		copy_datum(dbm_nextkey(db))
-#  define MYDBM_GET_TIME(db)		ndbm_get_time(db)
-#  define MYDBM_SET_TIME(db, time)	ndbm_set_time(db, time)
-#  define MYDBM_REORG(db)		/* nothing - not implemented */
+#  define MYDBM_BASE_CTRWOPEN(file)		ndbm_flopen(file, O_TRUNC|O_CREAT|O_RDWR, DBMODE)
+#  define MYDBM_BASE_CRWOPEN(file)             ndbm_flopen(file, O_CREAT|O_RDWR, DBMODE)
+#  define MYDBM_BASE_RWOPEN(file)		ndbm_flopen(file, O_RDWR, DBMODE)
+#  define MYDBM_BASE_RDOPEN(file)		ndbm_flopen(file, O_RDONLY, DBMODE)
+#  define MYDBM_BASE_INSERT(db, key, cont)	dbm_store(db, key, cont, DBM_INSERT)
+#  define MYDBM_BASE_REPLACE(db, key, cont)   dbm_store(db, key, cont, DBM_REPLACE)
+#  define MYDBM_BASE_EXISTS(db, key)		(dbm_fetch(db, key).dptr != NULL)
+#  define MYDBM_BASE_DELETE(db, key)		dbm_delete(db, key)
+#  define MYDBM_BASE_FETCH(db, key) 		copy_datum(dbm_fetch(db, key))
+#  define MYDBM_BASE_CLOSE(db)		ndbm_flclose(db)
+#  define MYDBM_BASE_FIRSTKEY(db)		copy_datum(dbm_firstkey(db))
+#  define MYDBM_BASE_NEXTKEY(db, key)		copy_datum(dbm_nextkey(db))
+#  define MYDBM_BASE_GET_TIME(db)		ndbm_get_time(db)
+#  define MYDBM_BASE_SET_TIME(db, time)	ndbm_set_time(db, time)
+#  define MYDBM_BASE_REORG(db)		/* nothing - not implemented */
+#  define MYDBM_BASE_FD(db)		dbm_dirfno(db)
 
 # elif defined(BTREE) && !defined(NDBM) && !defined(GDBM)
 
@@ -149,30 +153,63 @@ extern struct timespec btree_get_time(DB *db);
 extern void btree_set_time(DB *db, const struct timespec time);
 
 #  define DB_EXT			".bt"
-#  define MYDBM_FILE			DB*
+#  define MYDBM_BASE_FILE			DB*
 #  define MYDBM_DPTR(d)			((char *) (d).data)
 #  define MYDBM_SET_DPTR(d, value)	((d).data = (char *) (value))
 #  define MYDBM_DSIZE(d)		((d).size)
-#  define MYDBM_CTRWOPEN(file)		btree_flopen(file, O_TRUNC|O_CREAT|O_RDWR, DBMODE)
-#  define MYDBM_CRWOPEN(file)             btree_flopen(file, O_CREAT|O_RDWR, DBMODE)
-#  define MYDBM_RWOPEN(file)		btree_flopen(file, O_RDWR, DBMODE)
-#  define MYDBM_RDOPEN(file)		btree_flopen(file, O_RDONLY, DBMODE)
-#  define MYDBM_INSERT(db, key, cont)	btree_insert(db, key, cont)
-#  define MYDBM_REPLACE(db, key, cont)	btree_replace(db, key, cont)
-#  define MYDBM_EXISTS(db, key)		btree_exists(db, key)
-#  define MYDBM_DELETE(db, key)		((db->del)(db, &key, 0) ? -1 : 0)
-#  define MYDBM_FETCH(db, key)		btree_fetch(db, key)
-#  define MYDBM_CLOSE(db)		btree_close(db)
-#  define MYDBM_FIRSTKEY(db)		btree_firstkey(db)
-#  define MYDBM_NEXTKEY(db, key)	btree_nextkey(db)
-#  define MYDBM_GET_TIME(db)		btree_get_time(db)
-#  define MYDBM_SET_TIME(db, time)	btree_set_time(db, time)
-#  define MYDBM_REORG(db)		/* nothing - not implemented */
+#  define MYDBM_BASE_CTRWOPEN(file)		btree_flopen(file, O_TRUNC|O_CREAT|O_RDWR, DBMODE)
+#  define MYDBM_BASE_CRWOPEN(file)             btree_flopen(file, O_CREAT|O_RDWR, DBMODE)
+#  define MYDBM_BASE_RWOPEN(file)		btree_flopen(file, O_RDWR, DBMODE)
+#  define MYDBM_BASE_RDOPEN(file)		btree_flopen(file, O_RDONLY, DBMODE)
+#  define MYDBM_BASE_INSERT(db, key, cont)	btree_insert(db, key, cont)
+#  define MYDBM_BASE_REPLACE(db, key, cont)	btree_replace(db, key, cont)
+#  define MYDBM_BASE_EXISTS(db, key)		btree_exists(db, key)
+#  define MYDBM_BASE_DELETE(db, key)		((db->del)(db, &key, 0) ? -1 : 0)
+#  define MYDBM_BASE_FETCH(db, key)		btree_fetch(db, key)
+#  define MYDBM_BASE_CLOSE(db)		btree_close(db)
+#  define MYDBM_BASE_FIRSTKEY(db)		btree_firstkey(db)
+#  define MYDBM_BASE_NEXTKEY(db, key)	btree_nextkey(db)
+#  define MYDBM_BASE_GET_TIME(db)		btree_get_time(db)
+#  define MYDBM_BASE_SET_TIME(db, time)	btree_set_time(db, time)
+#  define MYDBM_BASE_REORG(db)		/* nothing - not implemented */
+#  define MYDBM_BASE_FD(db)		((db)->fd)(db)
 
 # else /* not GDBM or NDBM or BTREE */
 #  error Define either GDBM, NDBM or BTREE before including mydbm.h
 # endif /* not GDBM or NDBM or BTREE */
 
+/* Changes made through a handle opened with MYDBM_RWOPEN go to a delta
+ * log kept alongside the database rather than to the database itself, and
+ * every handle merges in the log when it is opened; see db_log.c.
+ * MYDBM_CTRWOPEN and MYDBM_CRWOPEN bypass the log, and are only for
+ * building a new database; MYDBM_CTRWOPEN holds the new contents in memory
+ * and writes them out in key order when the handle is closed.
+ */
+struct dblog;
+
+struct mydbm_file {
+	MYDBM_BASE_FILE base;
+	struct dblog *log;
+};
+
+typedef struct mydbm_file *MYDBM_FILE;
+
+# define MYDBM_CTRWOPEN(file)		dblog_open(file, O_TRUNC|O_CREAT|O_RDWR)
+# define MYDBM_CRWOPEN(file)		dblog_open(file, O_CREAT|O_RDWR)
+# define MYDBM_RWOPEN(file)		dblog_open(file, O_RDWR)
+# define MYDBM_RDOPEN(file)		dblog_open(file, O_RDONLY)
+# define MYDBM_INSERT(db, key, cont)	dblog_insert(db, key, cont)
+# define MYDBM_REPLACE(db, key, cont)	dblog_replace(db, key, cont)
+# define MYDBM_EXISTS(db, key)		dblog_exists(db, key)
+# define MYDBM_DELETE(db, key)		dblog_delete(db, key)
+# define MYDBM_FETCH(db, key)		dblog_fetch(db, key)
+# define MYDBM_CLOSE(db)		dblog_close(db)
+# define MYDBM_FIRSTKEY(db)		dblog_firstkey(db)
+# define MYDBM_NEXTKEY(db, key)		dblog_nextkey(db, key)
+# define MYDBM_GET_TIME(db)		dblog_get_time(db)
+# define MYDBM_SET_TIME(db, time)	dblog_set_time(db, time)
+# define MYDBM_REORG(db)		dblog_reorg(db)
+
 #define MYDBM_RESET_DSIZE(d)		(MYDBM_DSIZE(d) = strlen(MYDBM_DPTR(d)) + 1)
 #define MYDBM_SET(d, value)		do { MYDBM_SET_DPTR(d, value); MYDBM_RESET_DSIZE(d); } while (0)
 #define MYDBM_FREE_DPTR(d)		do { free (MYDBM_DPTR (d)); MYDBM_SET_DPTR (d, NULL); } while (0)
@@ -182,8 +219,44 @@ extern char *database;
 /* db_lookup.c */
 extern datum copy_datum (datum dat);
 
+/* db_log.c */
+extern int dblog_bypass;
+extern int dblog_lock_wait;
+extern MYDBM_FILE dblog_open (const char *file, int flags);
+extern void dblog_close (MYDBM_FILE dbf);
+extern datum dblog_fetch (MYDBM_FILE dbf, datum key);
+extern int dblog_exists (MYDBM_FILE dbf, datum key);
+extern int dblog_insert (MYDBM_FILE dbf, datum key, datum cont);
+extern int dblog_replace (MYDBM_FILE dbf, datum key, datum cont);
+extern int dblog_delete (MYDBM_FILE dbf, datum key);
+extern datum dblog_firstkey (MYDBM_FILE dbf);
+extern datum dblog_nextkey (MYDBM_FILE dbf, datum key);
+#  ifdef BTREE
+extern int dblog_nextkeydata (MYDBM_FILE dbf, datum *key, datum *cont);
+#  endif /* BTREE */
+extern struct timespec dblog_get_time (MYDBM_FILE dbf);
+extern void dblog_set_time (MYDBM_FILE dbf, const struct timespec time);
+extern void dblog_reorg (MYDBM_FILE dbf);
+extern char *dblog_name (const char *file);
+extern int dblog_wants_compaction (MYDBM_FILE dbf);
+extern int dblog_compact (MYDBM_FILE dbf, const char *newfile);
+extern void dblog_remove (const char *file);
+
 /* db_ver.c */
 extern void dbver_wr(MYDBM_FILE dbfile);
 extern int dbver_rd(MYDBM_FILE dbfile);
 
+/* db_portable.c */
+extern int dbportable_wr (MYDBM_FILE dbfile, const char *file,
+			  const char *digest);
+extern int dbportable_rd (MYDBM_FILE dbfile, const char *file,
+			  const char *digest);
+
+/* db_sections.c */
+extern void dbsections_build (MYDBM_FILE dbf);
+extern int dbsections_exist (MYDBM_FILE dbf);
+extern void dbsections_invalidate (MYDBM_FILE dbf);
+extern char **dbsections_lookup (MYDBM_FILE dbf, const char *section);
+extern datum dbsections_next_key (char ***next);
+
 #endif /* MYDBM_H */
@@ -146,6 +146,8 @@ int main (int argc, char *argv[])
 			*t = '~';
 		while ( (t = strchr (MYDBM_DPTR (content), '\t')) )
 			*t = ' ';
+		while ( (t = strchr (MYDBM_DPTR (content), '\n')) )
+			*t = ' ';
 		printf ("%s -> \"%s\"\n", nicekey, MYDBM_DPTR (content));
 		free (nicekey); 
 		MYDBM_FREE_DPTR (content);
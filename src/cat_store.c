@@ -0,0 +1,349 @@
+/*
+ * cat_store.c: content-addressed store of cat pages
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Many cat pages are formatted from identical sources: hard links that
+ * ult_src() does not resolve, copies of a page under several names, and
+ * untranslated copies of pages in per-locale hierarchies.  Each formatted
+ * cat page is therefore also linked into a store in the cat hierarchy,
+ * named after a SHA-256 digest of its source's contents, including any
+ * files it includes, and of the formatting settings.  When a cat page is
+ * missing or out of date, man looks for its source's digest in the store
+ * first, and if it is there it just links the stored page into place
+ * instead of formatting it again.  Cat pages remain ordinary files, so
+ * nothing else needs to know about the store.
+ * Since a cat page is judged up to date by comparing its modification
+ * time with that of its own source, a page is only linked to a stored
+ * page with the same modification time; otherwise it gets a copy (sharing
+ * the stored page's data where the file system allows) with its own.
+ *
+ * Stored pages that are no longer linked from any cat directory are
+ * removed by catman.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LINUX_FS_H
+#  include <linux/fs.h>
+#  include <sys/ioctl.h>
+#endif /* HAVE_LINUX_FS_H */
+
+#ifdef HAVE_SYS_SENDFILE_H
+#  include <sys/sendfile.h>
+#endif /* HAVE_SYS_SENDFILE_H */
+
+#include "stat-time.h"
+#include "timespec.h"
+#include "utimens.h"
+#include "xvasprintf.h"
+
+#include "gettext.h"
+#define _(String) gettext (String)
+
+#include "manconfig.h"
+
+#include "digest.h"
+#include "error.h"
+
+#include "cat_store.h"
+
+/* Return the store for the cat hierarchy containing CAT_FILE, which was
+ * formatted from a page in the locale LANG (as returned by lang_dir()).
+ * A per-locale cat hierarchy shares the store of the hierarchy above it,
+ * so that identical pages in different locales are only kept once.
+ */
+char *cat_store_dir (const char *cat_file, const char *lang)
+{
+	char *root = xstrdup (cat_file), *slash, *dir;
+	int depth;
+
+	/* Strip the file name and the section directory. */
+	for (depth = 0; depth < 2; ++depth) {
+		slash = strrchr (root, '/');
+		if (slash)
+			*slash = '\0';
+		else {
+			strcpy (root, ".");
+			break;
+		}
+	}
+
+	if (lang && *lang && !STREQ (lang, "C")) {
+		slash = strrchr (root, '/');
+		if (slash && STREQ (slash + 1, lang))
+			*slash = '\0';
+	}
+
+	dir = xasprintf ("%s%s", root, MAN_CAT_STORE);
+	free (root);
+	return dir;
+}
+
+/* Return the name under which the cat page formatted from SOURCE with
+ * the formatting settings PARAMS would be kept in STORE_DIR, or NULL if
+ * SOURCE fails.  SOURCE is a pipeline producing the page's text with any
+ * files it includes already substituted, since a page may include
+ * different files depending on where it is installed; this function runs
+ * it to completion.
+ */
+char *cat_store_object (const char *store_dir, pipeline *source,
+			const char *params)
+{
+	struct sha256_ctx ctx;
+	char digest[SHA256_HEX_SIZE];
+	const char *buf;
+	size_t len;
+
+	sha256_init (&ctx);
+	sha256_update (&ctx, params, strlen (params) + 1);
+
+	pipeline_want_out (source, -1);
+	pipeline_start (source);
+	for (;;) {
+		len = 65536;
+		buf = pipeline_read (source, &len);
+		if (!buf || !len)
+			break;
+		sha256_update (&ctx, buf, len);
+	}
+	if (pipeline_wait (source) != 0 || !buf)
+		return NULL;
+	sha256_finish (&ctx, digest);
+
+#ifdef COMP_CAT
+	return xasprintf ("%s/%s.%s", store_dir, digest, COMPRESS_EXT);
+#else /* !COMP_CAT */
+	return xasprintf ("%s/%s", store_dir, digest);
+#endif /* COMP_CAT */
+}
+
+/* Copy everything from IN_FD's current offset onwards to OUT_FD.  Return
+ * 0 on success.
+ */
+static int copy_contents (int in_fd, int out_fd)
+{
+	char buf[8192];
+	ssize_t n;
+
+#if defined(HAVE_LINUX_FS_H) && defined(FICLONE)
+	/* On file systems such as btrfs and XFS, the copy can share the
+	 * original's data.
+	 */
+	if (ioctl (out_fd, FICLONE, in_fd) == 0)
+		return 0;
+#endif /* HAVE_LINUX_FS_H && FICLONE */
+
+	/* Otherwise, try to keep the data in the kernel.  If either of
+	 * these gives up part of the way through, both offsets have moved
+	 * on together, so the next method picks up where it left off.
+	 */
+#ifdef HAVE_COPY_FILE_RANGE
+	while ((n = copy_file_range (in_fd, NULL, out_fd, NULL,
+				     1024 * 1024 * 1024, 0)) > 0)
+		;
+	if (n == 0)
+		return 0;
+#endif /* HAVE_COPY_FILE_RANGE */
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+	while ((n = sendfile (out_fd, in_fd, NULL, 1024 * 1024 * 1024)) > 0)
+		;
+	if (n == 0)
+		return 0;
+#endif /* HAVE_SENDFILE && HAVE_SYS_SENDFILE_H */
+
+	while ((n = read (in_fd, buf, sizeof buf)) != 0) {
+		const char *p = buf;
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		while (n > 0) {
+			ssize_t w = write (out_fd, p, n);
+			if (w < 0) {
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+			p += w;
+			n -= w;
+		}
+	}
+	return 0;
+}
+
+/* Make TO, which must not exist, a copy of FROM with the same mode and
+ * timestamps, since man judges cat pages by their modification times.
+ * If MTIME is non-NULL, give the copy that modification time instead.
+ * Return 0 on success.
+ */
+static int copy_file (const char *from, const char *to,
+		      const struct timespec *mtime)
+{
+	struct stat st;
+	struct timespec times[2];
+	int in_fd, out_fd, ret = -1;
+
+	in_fd = open (from, O_RDONLY);
+	if (in_fd < 0)
+		return -1;
+	if (fstat (in_fd, &st) < 0) {
+		close (in_fd);
+		return -1;
+	}
+	out_fd = open (to, O_WRONLY | O_CREAT | O_EXCL, st.st_mode & 07777);
+	if (out_fd < 0) {
+		close (in_fd);
+		return -1;
+	}
+
+	times[0] = get_stat_atime (&st);
+	times[1] = mtime ? *mtime : get_stat_mtime (&st);
+	if (copy_contents (in_fd, out_fd) == 0 &&
+	    fchmod (out_fd, st.st_mode & 07777) == 0 &&
+	    fdutimens (out_fd, NULL, times) == 0)
+		ret = 0;
+	if (close (out_fd) < 0)
+		ret = -1;
+	close (in_fd);
+
+	if (ret)
+		unlink (to);
+	return ret;
+}
+
+/* Make TO a hard link to FROM, replacing any existing TO atomically.
+ * Every name of a file shares its modification time, so if MTIME is
+ * non-NULL and differs from FROM's, or if FROM cannot be linked because it
+ * is on another file system or already has as many links as the file
+ * system allows, make TO a copy with modification time MTIME instead.
+ * cat_store_prune() does not count such copies as uses of a stored page.
+ * Return 0 on success.
+ */
+static int replace_link (const char *from, const char *to,
+			 const struct timespec *mtime)
+{
+	struct stat from_st, to_st;
+	char *tmp, *slash;
+	int linkable, fd, ret = -1;
+
+	if (stat (from, &from_st))
+		return -1;
+	linkable = !mtime ||
+		   timespec_cmp (get_stat_mtime (&from_st), *mtime) == 0;
+	if (linkable && stat (to, &to_st) == 0 &&
+	    from_st.st_dev == to_st.st_dev && from_st.st_ino == to_st.st_ino)
+		/* Already linked; rename() would do nothing. */
+		return 0;
+
+	tmp = xstrdup (to);
+	slash = strrchr (tmp, '/');
+	if (slash)
+		*(slash + 1) = '\0';
+	else
+		*tmp = '\0';
+	tmp = appendstr (tmp, "catXXXXXX", NULL);
+	fd = mkstemp (tmp);
+	if (fd < 0) {
+		free (tmp);
+		return -1;
+	}
+	close (fd);
+	unlink (tmp);
+
+	if ((linkable && link (from, tmp) == 0) ||
+	    ((!linkable ||
+	      errno == EXDEV || errno == EMLINK || errno == EPERM) &&
+	     copy_file (from, tmp, mtime) == 0)) {
+		if (rename (tmp, to) == 0)
+			ret = 0;
+		else
+			unlink (tmp);
+	}
+	if (ret)
+		debug ("can't link %s to %s: %s\n", to, from, strerror (errno));
+
+	free (tmp);
+	return ret;
+}
+
+/* If OBJECT is in the store, put it into place as CAT_FILE, formatted from
+ * a source last modified at MTIME, and return 0; otherwise return -1.
+ */
+int cat_store_fetch (const char *object, const char *cat_file,
+		     struct timespec mtime)
+{
+	if (access (object, R_OK))
+		return -1;
+	if (replace_link (object, cat_file, &mtime))
+		return -1;
+	debug ("fetched %s from cat store %s\n", cat_file, object);
+	return 0;
+}
+
+/* Add the freshly formatted CAT_FILE to the store as OBJECT. */
+void cat_store_add (const char *object, const char *cat_file)
+{
+	if (replace_link (cat_file, object, NULL) == 0)
+		debug ("added %s to cat store as %s\n", cat_file, object);
+}
+
+/* Remove the pages in STORE_DIR that are no longer linked from anywhere
+ * else.
+ */
+void cat_store_prune (const char *store_dir)
+{
+	DIR *dir;
+	struct dirent *ent;
+
+	dir = opendir (store_dir);
+	if (!dir)
+		return;
+	while ((ent = readdir (dir)) != NULL) {
+		struct stat st;
+		char *path;
+
+		/* Skip temporary links still being made. */
+		if (ent->d_name[0] == '.' || STRNEQ (ent->d_name, "cat", 3))
+			continue;
+		path = xasprintf ("%s/%s", store_dir, ent->d_name);
+		if (lstat (path, &st) == 0 && S_ISREG (st.st_mode) &&
+		    st.st_nlink == 1) {
+			debug ("removing unused stored cat %s\n", path);
+			if (unlink (path) && errno != ENOENT)
+				error (0, errno, _("can't unlink %s"), path);
+		}
+		free (path);
+	}
+	closedir (dir);
+}
@@ -0,0 +1,33 @@
+/*
+ * cat_store.h: interface to the content-addressed store of cat pages
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "pipeline.h"
+
+#include "timespec.h"
+
+extern char *cat_store_dir (const char *cat_file, const char *lang);
+extern char *cat_store_object (const char *store_dir, pipeline *source,
+			       const char *params);
+extern int cat_store_fetch (const char *object, const char *cat_file,
+			    struct timespec mtime);
+extern void cat_store_add (const char *object, const char *cat_file);
+extern void cat_store_prune (const char *store_dir);
@@ -34,7 +34,9 @@
 #include <stdio.h>
 #include <assert.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -62,6 +64,8 @@
 
 #include "argp.h"
 #include "dirname.h"
+#include "stat-time.h"
+#include "timespec.h"
 
 #include "gettext.h"
 #include <locale.h>
@@ -77,6 +81,7 @@
 #include "mydbm.h"
 #include "db_storage.h"
 
+#include "cat_store.h"
 #include "manp.h"
 
 /* globals */
@@ -87,6 +92,7 @@ char *manp;
 extern char *user_config_file;
 char *database;
 static const char **sections;
+static int jobs = 1;
 
 const char *argp_program_version = "catman " PACKAGE_VERSION;
 const char *argp_program_bug_address = PACKAGE_BUGREPORT;
@@ -98,6 +104,7 @@ static struct argp_option options[] = {
 	{ "debug",		'd',	0,		0,	N_("emit debugging messages") },
 	{ "manpath",		'M',	N_("PATH"),	0,	N_("set search path for manual pages to PATH") },
 	{ "config-file",	'C',	N_("FILE"),	0,	N_("use this user configuration file") },
+	{ "jobs",		'j',	N_("N"),	0,	N_("run up to N man processes at once") },
 	{ 0, 'h', 0, OPTION_HIDDEN, 0 }, /* compatibility for --help */
 	{ 0 }
 };
@@ -116,6 +123,17 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 		case 'C':
 			user_config_file = arg;
 			return 0;
+		case 'j': {
+			char *end;
+			long n = strtol (arg, &end, 10);
+
+			if (!*arg || *end || n < 1 || n > INT_MAX)
+				argp_error (state,
+					    _("invalid number of jobs: %s"),
+					    arg);
+			jobs = (int) n;
+			return 0;
+		}
 		case 'h':
 			argp_state_help (state, state->out_stream,
 					 ARGP_HELP_STD_HELP);
@@ -171,11 +189,43 @@ static void post_fork (void)
 		MYDBM_CLOSE (dbf_close_post_fork);
 }
 
-/* Execute man with the appropriate catman args.  Always frees cmd. */
+/* With --jobs, a section's pages are handed out in batches of at most this
+ * many, so that large sections are shared among the running man processes.
+ */
+#define JOB_PAGES 64
+
+static pipeline **running;
+static int running_len;
+
+/* Wait for the oldest running man command to finish. */
+static void wait_for_job (void)
+{
+	pipeline *p = running[0];
+	int status;
+
+	--running_len;
+	memmove (running, running + 1, running_len * sizeof *running);
+
+	status = pipeline_wait (p);
+	pipeline_free (p);
+	if (status)
+		error (CHILD_FAIL, 0,
+		       _("man command failed with exit status %d"), status);
+}
+
+/* Wait for all running man commands to finish. */
+static void wait_for_jobs (void)
+{
+	while (running_len)
+		wait_for_job ();
+}
+
+/* Execute man with the appropriate catman args, running at most jobs
+ * commands at once.  Always frees cmd.
+ */
 static void catman (pipecmd *cmd)
 {
 	pipeline *p;
-	int status;
 
 	if (debug_level) {
 		/* just show the command, but don't execute it */
@@ -186,11 +236,14 @@ static void catman (pipecmd *cmd)
 		return;
 	}
 
+	if (!running)
+		running = XNMALLOC (jobs, pipeline *);
+	if (running_len == jobs)
+		wait_for_job ();
+
 	p = pipeline_new_commands (cmd, NULL);
-	status = pipeline_run (p);
-	if (status)
-		error (CHILD_FAIL, 0,
-		       _("man command failed with exit status %d"), status);
+	pipeline_start (p);
+	running[running_len++] = p;
 }
 
 /* Add key to this command, stripping off tab-and-following if necessary.
@@ -217,15 +270,52 @@ static size_t add_arg (pipecmd *cmd, datum key)
 	return len;
 }
 
+/* Return non-zero if the cat page in the directory CATDIR_FD for ENTRY,
+ * whose database key is KEY, is missing or does not match the
+ * modification time of its source.  man makes the final decision, but
+ * this saves running it at all for pages that are already up to date.
+ */
+static int cat_is_stale (int catdir_fd, datum key,
+			 const struct mandata *entry)
+{
+	const char *name = entry->name ? entry->name : MYDBM_DPTR (key);
+	size_t name_len = strcspn (name, "\t");
+	char *cat_name;
+	struct stat st;
+	int stale = 1;
+
+	if (catdir_fd < 0)
+		return 1;
+
+#ifdef COMP_CAT
+	cat_name = xasprintf ("%.*s.%s.%s", (int) name_len, name, entry->ext,
+			      COMPRESS_EXT);
+#else /* !COMP_CAT */
+	cat_name = xasprintf ("%.*s.%s", (int) name_len, name, entry->ext);
+#endif /* COMP_CAT */
+
+	if (fstatat (catdir_fd, cat_name, &st, 0) == 0 && st.st_size > 0 &&
+	    timespec_cmp (get_stat_mtime (&st), entry->mtime) == 0) {
+		debug ("%s is up to date\n", cat_name);
+		stale = 0;
+	}
+
+	free (cat_name);
+	return stale;
+}
+
 /* find all pages that are in the supplied manpath and section and that are
-   ultimate source files. */
-static int parse_for_sec (const char *manpath, const char *section)
+   ultimate source files, and whose cat pages in catdir need updating. */
+static int parse_for_sec (const char *manpath, const char *section,
+			  const char *catdir)
 {
 	MYDBM_FILE dbf;
 	pipecmd *basecmd, *cmd;
 	datum key;
+	char **indexed, **next_indexed = NULL;
 	size_t arg_size, initial_bit;
-	int message = 1, first_arg;
+	int message = 1, first_arg, max_args;
+	int catdir_fd;
 
 	dbf = MYDBM_RDOPEN (database);
 	if (!dbf) {
@@ -238,6 +328,12 @@ static int parse_for_sec (const char *manpath, const char *section)
 	}
 	dbf_close_post_fork = dbf;
 
+	catdir_fd = open (catdir, O_RDONLY);
+	if (catdir_fd < 0)
+		debug ("can't open %s: %s\n", catdir, strerror (errno));
+	else
+		fcntl (catdir_fd, F_SETFD, FD_CLOEXEC);
+
 	basecmd = pipecmd_new (MAN);
 	pipecmd_clearenv (basecmd);
 
@@ -257,9 +353,20 @@ static int parse_for_sec (const char *manpath, const char *section)
 
 	cmd = pipecmd_dup (basecmd);
 	first_arg = pipecmd_get_nargs (cmd);
+	max_args = MAX_ARGS;
+	if (jobs > 1 && first_arg + JOB_PAGES < max_args)
+		max_args = first_arg + JOB_PAGES;
 
 	arg_size = initial_bit;
-	key = MYDBM_FIRSTKEY (dbf);
+
+	/* Only look at the entries in this section if mandb has indexed
+	   them; otherwise we have to go through the whole database. */
+	indexed = dbsections_lookup (dbf, section);
+	if (indexed) {
+		next_indexed = indexed;
+		key = dbsections_next_key (&next_indexed);
+	} else
+		key = MYDBM_FIRSTKEY (dbf);
 
 	while (MYDBM_DPTR (key) != NULL) {
 		datum nextkey;
@@ -270,6 +377,9 @@ static int parse_for_sec (const char *manpath, const char *section)
 
 			content = MYDBM_FETCH (dbf, key);
 
+			/* indexed entries may since have been deleted */
+			if (!MYDBM_DPTR (content) && indexed)
+				goto next;
 			if (!MYDBM_DPTR (content))
 				error (FATAL, 0,
 				       _( "NULL content for key: %s"),
@@ -285,7 +395,8 @@ static int parse_for_sec (const char *manpath, const char *section)
 				   page and the section matches the one we're
 				   currently dealing with */
 				if (entry.id == ULT_MAN && 
-				    strcmp (entry.sec, section) == 0) {
+				    strcmp (entry.sec, section) == 0 &&
+				    cat_is_stale (catdir_fd, key, &entry)) {
 					if (message) {
 						printf (_("\nUpdating cat files for section %s of man hierarchy %s\n"),
 							section, manpath);
@@ -303,7 +414,7 @@ static int parse_for_sec (const char *manpath, const char *section)
 					   space too */ 
 				    	if (arg_size >= ARG_MAX - NAME_MAX ||
 				    	    pipecmd_get_nargs (cmd) ==
-						    MAX_ARGS) {
+						    max_args) {
 						catman (cmd);
 
 						cmd = pipecmd_dup (basecmd);
@@ -321,10 +432,17 @@ static int parse_for_sec (const char *manpath, const char *section)
 			MYDBM_FREE_DPTR (content);
 		}
 
-		nextkey = MYDBM_NEXTKEY (dbf, key);
+next:
+		if (indexed)
+			nextkey = dbsections_next_key (&next_indexed);
+		else
+			nextkey = MYDBM_NEXTKEY (dbf, key);
 		MYDBM_FREE_DPTR (key);
 		key = nextkey;
 	}
+	free (indexed);
+	if (catdir_fd >= 0)
+		close (catdir_fd);
 
 	dbf_close_post_fork = NULL;
 	MYDBM_CLOSE (dbf);
@@ -417,16 +535,25 @@ int main (int argc, char *argv[])
 				continue;
 			if (check_access (catpath))
 				continue;
-			if (parse_for_sec (*mp, *sp)) {
+			if (parse_for_sec (*mp, *sp, catpath)) {
 				error (0, 0, _("unable to update %s"), *mp);
 				break;
 			}
 		}
-			
+
+		/* Drop stored cat pages that are no longer linked from any
+		 * cat directory, once nothing is adding to them.
+		 */
+		wait_for_jobs ();
+		*(catpath + len) = '\0';
+		catpath = appendstr (catpath, MAN_CAT_STORE, NULL);
+		cat_store_prune (catpath);
+
 		free (catpath);
 	}
 
 	free_pathlist (manpathlist);
+	free (running);
 	free (locale);
 	free (program_name);
 	exit (OK);
@@ -54,6 +54,7 @@
 
 #include "error.h"
 #include "hashtable.h"
+#include "manifest.h"
 #include "orderfiles.h"
 #include "security.h"
 
@@ -62,6 +63,7 @@
 
 #include "descriptions.h"
 #include "filenames.h"
+#include "fragments.h"
 #include "globbing.h"
 #include "manp.h"
 #include "ult_src.h"
@@ -70,6 +72,7 @@
 int opt_test;		/* don't update db */
 int pages;
 int force_rescan = 0;
+int from_fragments = 0;	/* use precomputed whatis fragments */
 
 static struct hashtable *whatis_hash = NULL;
 
@@ -111,6 +114,54 @@ static void gripe_rwopen_failed (void)
 	}
 }
 
+/* If there is an up-to-date whatis fragment for ULT (FILE with any
+ * symbolic or hard links resolved), return it and fill in TRACE as
+ * ult_src() would have done, without having to open the page.
+ */
+static const struct fragment *fresh_fragment (const char *file,
+					      const char *path,
+					      const char *ult,
+					      struct ult_trace *trace)
+{
+	const struct fragment *frag;
+	struct stat st;
+	size_t i;
+
+	if (manifest_stat (ult, &st) < 0)
+		return NULL;
+	frag = fragment_lookup (path, ult, &st);
+	if (!frag)
+		return NULL;
+
+	trace->len = 0;
+	trace->max = frag->so_len + 2;
+	trace->names = XNMALLOC (trace->max, char *);
+	trace->names[trace->len++] = xstrdup (file);
+	for (i = 0; i < frag->so_len; ++i) {
+		if (*frag->so[i] == '/')
+			trace->names[trace->len++] = xstrdup (frag->so[i]);
+		else
+			trace->names[trace->len++] =
+				xasprintf ("%s/%s", path, frag->so[i]);
+	}
+	trace->names[trace->len] = xstrdup (frag->so_len ?
+		trace->names[trace->len - 1] : ult);
+	++trace->len;
+
+	/* The description came from the end of the .so chain, so that
+	 * must not have changed either.
+	 */
+	if (frag->so_len &&
+	    (manifest_stat (trace->names[trace->len - 1], &st) < 0 ||
+	     !fragment_lookup (path, trace->names[trace->len - 1], &st))) {
+		free_ult_trace (trace);
+		memset (trace, 0, sizeof (struct ult_trace));
+		return NULL;
+	}
+
+	return frag;
+}
+
 /* Take absolute filename and path (for ult_src) and do sanity checks on
  * file. Also check that file is non-zero in length and is not already in
  * the db. If not, find its ult_src() and see if we have the whatis cached,
@@ -128,6 +179,7 @@ void test_manfile (MYDBM_FILE dbf, const char *file, const char *path)
 	size_t len;
 	struct ult_trace ult_trace;
 	struct whatis_hashent *whatis;
+	const struct fragment *frag = NULL;
 
 	memset (&lg, 0, sizeof (struct lexgrog));
 	memset (&info, 0, sizeof (struct mandata));
@@ -226,9 +278,16 @@ void test_manfile (MYDBM_FILE dbf, const char *file, const char *path)
 		/* Trace the file to its ultimate source, otherwise we'll be
 		 * looking for whatis info in files containing only '.so
 		 * manx/foo.x', which will give us an unobtainable whatis
-		 * for the entry. */
-		ult = ult_src (file, path, &buf,
-			       SO_LINK | SOFT_LINK | HARD_LINK, &ult_trace);
+		 * for the entry.  A whatis fragment may have done this for
+		 * us already. */
+		if (from_fragments)
+			frag = fresh_fragment (file, path, ult, &ult_trace);
+		if (frag)
+			ult = ult_trace.names[ult_trace.len - 1];
+		else
+			ult = ult_src (file, path, &buf,
+				       SO_LINK | SOFT_LINK | HARD_LINK,
+				       &ult_trace);
 	}
 
 	if (!ult) {
@@ -257,7 +316,16 @@ void test_manfile (MYDBM_FILE dbf, const char *file, const char *path)
 
 	if (whatis)
 		lg.whatis = whatis->whatis ? xstrdup (whatis->whatis) : NULL;
-	else {
+	else if (frag) {
+		debug ("using whatis fragment for %s\n", file);
+		lg.whatis = xstrdup (frag->whatis);
+		lg.filters = xstrdup (frag->filters ? frag->filters : "");
+
+		whatis = XMALLOC (struct whatis_hashent);
+		whatis->whatis = xstrdup (lg.whatis);
+		memcpy (&whatis->trace, &ult_trace, sizeof (ult_trace));
+		hashtable_install (whatis_hash, ult, strlen (ult), whatis);
+	} else {
 		/* Cache miss; go and get the whatis info in its raw state. */
 		char *file_base = base_name (file);
 
@@ -437,6 +505,7 @@ static int testmandirs (const char *path, const char *catpath,
 {
 	DIR *dir;
 	struct dirent *mandir;
+	MYDBM_FILE dbf = NULL;
 	int amount = 0;
 	int created = 0;
 
@@ -457,7 +526,6 @@ static int testmandirs (const char *path, const char *catpath,
 	while( (mandir = readdir (dir)) ) {
 		struct stat stbuf;
 		struct timespec mtime;
-		MYDBM_FILE dbf;
 
 		if (strncmp (mandir->d_name, "man", 3) != 0)
 			continue;
@@ -488,7 +556,11 @@ static int testmandirs (const char *path, const char *catpath,
 			 */
 			mkcatdirs (path, catpath);
 
-			/* Open the db in CTRW mode to store the $ver$ ID */
+			/* Open the db in CTRW mode to store the $ver$ ID.
+			 * Keep it open until every directory has been
+			 * scanned, so that the whole database is written out
+			 * in one go when it is closed.
+			 */
 
 			dbf = MYDBM_CTRWOPEN (database);
 			if (dbf == NULL) {
@@ -509,7 +581,7 @@ static int testmandirs (const char *path, const char *catpath,
 			dbver_wr (dbf);
 
 			created = 1;
-		} else
+		} else if (!create)
 			dbf = MYDBM_RWOPEN(database);
 
 		if (!dbf) {
@@ -530,9 +602,14 @@ static int testmandirs (const char *path, const char *catpath,
 				fprintf (stderr, "\n");
 		}
 		add_dir_entries (dbf, path, mandir->d_name);
-		MYDBM_CLOSE (dbf);
+		if (!create) {
+			MYDBM_CLOSE (dbf);
+			dbf = NULL;
+		}
 		amount++;
 	}
+	if (dbf)
+		MYDBM_CLOSE (dbf);
 	closedir (dir);
 
 	return amount;
@@ -592,6 +669,55 @@ int create_db (const char *manpath, const char *catpath)
 	return amount;
 }
 
+/* If catpath holds a portable database built from a hierarchy with the
+ * same contents as manpath, load it into a new database rather than
+ * scanning every page.  Returns the number of entries loaded, or -1 if
+ * there is no usable portable database.
+ */
+int import_portable_db (const char *manpath, const char *catpath)
+{
+	char *portable, *manifest, *digest = NULL;
+	MYDBM_FILE dbf;
+	int amount = -1;
+
+	portable = xasprintf ("%s%s", catpath, MAN_DB_PORTABLE);
+	manifest = xasprintf ("%s%s", catpath, MAN_MANIFEST);
+	if (access (portable, R_OK) != 0)
+		goto out;
+
+	/* Checking the portable database against the local hierarchy only
+	 * requires an up-to-date manifest, not reading any pages.
+	 */
+	if (!manifest_is_current (manpath, manifest) &&
+	    manifest_write (manpath, manifest) < 0)
+		goto out;
+	digest = manifest_digest (manifest);
+	if (!digest)
+		goto out;
+
+	dbf = MYDBM_CTRWOPEN (database);
+	if (dbf == NULL) {
+		if (errno != EACCES && errno != EROFS)
+			error (0, errno, _("can't create index cache %s"),
+			       database);
+		goto out;
+	}
+	amount = dbportable_rd (dbf, portable, digest);
+	MYDBM_CLOSE (dbf);
+
+	if (amount >= 0) {
+		debug ("import_portable_db(%s): loaded %s\n",
+		       manpath, portable);
+		update_db_time ();
+	}
+
+out:
+	free (digest);
+	free (manifest);
+	free (portable);
+	return amount;
+}
+
 /* Make sure an existing database is essentially sane. */
 static int sanity_check_db (MYDBM_FILE dbf)
 {
@@ -706,6 +832,27 @@ pointers_next:
 	}
 }
 
+/* Bring the entries in DBF for the single page FILENAME in MANPATH up to
+ * date, removing any left over from its previous contents.
+ */
+void update_one_file (MYDBM_FILE dbf, const char *manpath,
+		      const char *filename)
+{
+	struct mandata info;
+	char *manpage;
+
+	memset (&info, 0, sizeof (struct mandata));
+	manpage = filename_info (filename, &info, "");
+	if (info.name) {
+		dbdelete (dbf, info.name, &info);
+		purge_pointers (dbf, info.name);
+		free (info.name);
+	}
+	free (manpage);
+
+	test_manfile (dbf, filename, manpath);
+}
+
 /* Count the number of exact extension matches returned from look_for_file()
  * (which may return inexact extension matches in some cases). It may turn
  * out that this is better handled in look_for_file() itself.
@@ -25,7 +25,10 @@
 /* check_mandirs.c */
 extern void test_manfile (MYDBM_FILE dbf, const char *file, const char *path);
 extern int create_db (const char *manpath, const char *catpath);
+extern int import_portable_db (const char *manpath, const char *catpath);
 extern int update_db (const char *manpath, const char *catpath);
 extern void purge_pointers (MYDBM_FILE dbf, const char *name);
+extern void update_one_file (MYDBM_FILE dbf, const char *manpath,
+			     const char *filename);
 extern int purge_missing (const char *manpath, const char *catpath,
 			  int will_run_mandb);
@@ -47,6 +47,7 @@
 
 #include "error.h"
 #include "pipeline.h"
+#include "manifest.h"
 
 /* Take filename as arg, return structure containing decompressor 
    and extension, or NULL if no comp extension found. 
@@ -109,7 +110,7 @@ struct compression *comp_file (const char *filename)
 		
 		compfile = appendstr (compfile, comp->ext, NULL);
 
-		if (stat (compfile, &buf) == 0) {
+		if (manifest_stat (compfile, &buf) == 0) {
 			comp->stem = compfile;
 			return comp;
 		}
@@ -0,0 +1,300 @@
+/*
+ * fragments.c: precomputed whatis fragments
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Nearly all of the time taken to build a database goes into opening,
+ * decompressing, and parsing pages to find their NAME sections, even
+ * though these never change once a page has been packaged.  Packages may
+ * therefore ship the results of that work in a fragment file in the
+ * hierarchy's whatis.d directory, which "lexgrog --fragment" produces and
+ * "mandb --from-fragments" uses instead of parsing pages.
+ *
+ * A fragment file starts with the line "man-db whatis fragment 1",
+ * followed by one stanza per page.  Stanzas are separated by empty lines
+ * and consist of lines of the form "FIELD VALUE":
+ *
+ *   page	page file name, relative to the hierarchy (required, first)
+ *   size	page size in bytes
+ *   mtime	page modification time, in seconds since the epoch
+ *   filters	preprocessing filters, as shown by "lexgrog --filters"
+ *   so		target of a .so request, relative to the hierarchy (one
+ *		line for each step in a chain of .so requests)
+ *   whatis	one NAME section entry, "name[, name...] - description"
+ *
+ * Fields are separated from their values by a single space.  An entry is
+ * only used if the page's size and modification time still match;
+ * otherwise the page is parsed as usual.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "canonicalize.h"
+#include "xvasprintf.h"
+
+#include "gettext.h"
+#define _(String) gettext (String)
+
+#include "manconfig.h"
+
+#include "error.h"
+#include "hashtable.h"
+
+#include "fragments.h"
+#include "ult_src.h"
+
+#define FRAGMENT_HEADER "man-db whatis fragment 1"
+
+/* Fragments for the hierarchy most recently looked up, keyed by page. */
+static struct hashtable *fragments;
+static char *fragments_path;
+
+static void fragment_hashtable_free (void *defn)
+{
+	struct fragment *frag = defn;
+	size_t i;
+
+	free (frag->page);
+	free (frag->filters);
+	for (i = 0; i < frag->so_len; ++i)
+		free (frag->so[i]);
+	free (frag->so);
+	free (frag->whatis);
+	free (frag);
+}
+
+/* Return NAME relative to PATH if it is within it, otherwise NAME. */
+static const char *relative_name (const char *path, const char *name)
+{
+	size_t len = strlen (path);
+
+	if (STREQ (path, ".") && STRNEQ (name, "./", 2))
+		return name + 2;
+	if (STRNEQ (name, path, len) && name[len] == '/')
+		return name + len + 1;
+	return name;
+}
+
+/* Print a fragment stanza for PAGE, a file within the hierarchy PATH whose
+ * status is ST, given the FILTERS and WHATIS returned by find_name() and
+ * the TRACE returned by ult_src() with SO_LINK.
+ */
+void fragment_print (FILE *stream, const char *path, const char *page,
+		     const struct stat *st, const char *filters,
+		     const struct ult_trace *trace, const char *whatis)
+{
+	char *canon_path = canonicalize_file_name (path);
+	size_t i;
+	const char *record;
+
+	fprintf (stream, "page %s\n", relative_name (path, page));
+	fprintf (stream, "size %llu\n", (unsigned long long) st->st_size);
+	fprintf (stream, "mtime %ld\n", (long) st->st_mtime);
+	if (filters && *filters)
+		fprintf (stream, "filters %s\n", filters);
+	/* The trace starts with the page itself and ends with its ultimate
+	 * source twice.
+	 */
+	for (i = 1; trace && i + 1 < trace->len; ++i) {
+		const char *so = relative_name (path, trace->names[i]);
+
+		/* .so targets found relative to the page are canonicalised. */
+		if (so == trace->names[i] && canon_path)
+			so = relative_name (canon_path, trace->names[i]);
+		fprintf (stream, "so %s\n", so);
+	}
+	for (record = whatis; record && *record; ) {
+		const char *end = strchr (record, 0x11);
+		int len = end ? (int) (end - record) : (int) strlen (record);
+
+		if (len)
+			fprintf (stream, "whatis %.*s\n", len, record);
+		record = end ? end + 1 : record + len;
+	}
+	putc ('\n', stream);
+
+	free (canon_path);
+}
+
+static void install_fragment (struct fragment *frag)
+{
+	if (!frag)
+		return;
+	if (!frag->whatis) {
+		/* Nothing useful to say; parse the page instead. */
+		fragment_hashtable_free (frag);
+		return;
+	}
+	hashtable_install (fragments, frag->page, strlen (frag->page), frag);
+}
+
+static void load_fragment_file (const char *file)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t n = 0;
+	ssize_t len;
+	struct fragment *frag = NULL;
+
+	fp = fopen (file, "r");
+	if (!fp) {
+		error (0, errno, _("can't open %s"), file);
+		return;
+	}
+
+	len = getline (&line, &n, fp);
+	if (len < 0 || !STREQ (line, FRAGMENT_HEADER "\n")) {
+		error (0, 0, _("%s: not a whatis fragment file"), file);
+		goto out;
+	}
+
+	while ((len = getline (&line, &n, fp)) >= 0) {
+		char *value;
+
+		if (len && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (!*line) {
+			install_fragment (frag);
+			frag = NULL;
+			continue;
+		}
+
+		value = strchr (line, ' ');
+		if (!value) {
+			debug ("%s: ignoring malformed line '%s'\n",
+			       file, line);
+			continue;
+		}
+		*value++ = '\0';
+
+		if (STREQ (line, "page")) {
+			install_fragment (frag);
+			frag = XZALLOC (struct fragment);
+			frag->page = xstrdup (value);
+			frag->size = -1;
+			frag->mtime = -1;
+		} else if (!frag)
+			debug ("%s: ignoring '%s' outside stanza\n",
+			       file, line);
+		else if (STREQ (line, "size"))
+			frag->size = (off_t) strtoull (value, NULL, 10);
+		else if (STREQ (line, "mtime"))
+			frag->mtime = (time_t) strtol (value, NULL, 10);
+		else if (STREQ (line, "filters")) {
+			free (frag->filters);
+			frag->filters = xstrdup (value);
+		} else if (STREQ (line, "so")) {
+			frag->so = xnrealloc (frag->so, frag->so_len + 1,
+					      sizeof *frag->so);
+			frag->so[frag->so_len++] = xstrdup (value);
+		} else if (STREQ (line, "whatis")) {
+			if (frag->whatis) {
+				char sep[2] = { 0x11, '\0' };
+				frag->whatis = appendstr (frag->whatis, sep,
+							  value, NULL);
+			} else
+				frag->whatis = xstrdup (value);
+		}
+		/* Ignore unknown fields for forward compatibility. */
+	}
+	install_fragment (frag);
+
+out:
+	free (line);
+	fclose (fp);
+}
+
+/* Load all fragment files for the hierarchy PATH. */
+static void load_fragments (const char *path)
+{
+	char *dirname = xasprintf ("%s%s", path, MAN_FRAGMENTS);
+	DIR *dir;
+	struct dirent *ent;
+
+	free_fragments ();
+	fragments = hashtable_create (&fragment_hashtable_free);
+	fragments_path = xstrdup (path);
+
+	dir = opendir (dirname);
+	if (!dir) {
+		if (errno != ENOENT)
+			error (0, errno, _("can't search directory %s"),
+			       dirname);
+		free (dirname);
+		return;
+	}
+	while ((ent = readdir (dir)) != NULL) {
+		char *file;
+
+		if (ent->d_name[0] == '.')
+			continue;
+		file = xasprintf ("%s/%s", dirname, ent->d_name);
+		debug ("loading whatis fragments from %s\n", file);
+		load_fragment_file (file);
+		free (file);
+	}
+	closedir (dir);
+	free (dirname);
+}
+
+/* Return the fragment entry for FILE within the hierarchy PATH, as long as
+ * it still describes FILE as it is now (with status ST); otherwise NULL.
+ */
+const struct fragment *fragment_lookup (const char *path, const char *file,
+					const struct stat *st)
+{
+	const char *page = relative_name (path, file);
+	size_t len = strlen (page);
+	struct nlist *np;
+	const struct fragment *frag;
+
+	if (!fragments_path || !STREQ (fragments_path, path))
+		load_fragments (path);
+
+	np = hashtable_lookup_structure (fragments, page, len);
+	if (!np || np->name[len] != '\0')
+		return NULL;
+	frag = np->defn;
+
+	if (frag->size != st->st_size || frag->mtime != st->st_mtime) {
+		debug ("whatis fragment for %s is stale\n", file);
+		return NULL;
+	}
+	return frag;
+}
+
+void free_fragments (void)
+{
+	if (fragments) {
+		hashtable_free (fragments);
+		fragments = NULL;
+	}
+	free (fragments_path);
+	fragments_path = NULL;
+}
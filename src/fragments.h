@@ -0,0 +1,45 @@
+/*
+ * fragments.h: interface to precomputed whatis fragments
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+struct ult_trace;
+
+struct fragment {
+	char *page;		/* relative to the hierarchy */
+	off_t size;
+	time_t mtime;
+	char *filters;
+	char **so;		/* .so chain, relative to the hierarchy */
+	size_t so_len;
+	char *whatis;		/* as returned by find_name() */
+};
+
+extern void fragment_print (FILE *stream, const char *path, const char *page,
+			    const struct stat *st, const char *filters,
+			    const struct ult_trace *trace, const char *whatis);
+extern const struct fragment *fragment_lookup (const char *path,
+					       const char *file,
+					       const struct stat *st);
+extern void free_fragments (void);
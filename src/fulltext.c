@@ -0,0 +1,484 @@
+/*
+ * fulltext.c: full-text index used by man -K
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * man -K has to read every page in the hierarchy, which is slow,
+ * especially when they are not already in the page cache.  If asked to,
+ * mandb therefore records the set of trigrams (sequences of three
+ * characters) that appear in each page, and man -K only needs to search
+ * the pages that contain all the trigrams of the text it is looking for.
+ *
+ * Only ASCII characters other than newline are indexed, with letters
+ * folded to lower case, so the index never rules out a page that a
+ * case-insensitive search would match.  Each page's trigrams are stored
+ * in ascending order as differences from the previous one, in a variable
+ * number of bytes.  Pages are indexed again when their modification time
+ * or size changes; pages that are missing from the index or have changed
+ * since it was written are always searched.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "stat-time.h"
+#include "timespec.h"
+#include "xvasprintf.h"
+
+#include "manconfig.h"
+
+#include "decompress.h"
+#include "hashtable.h"
+#include "strsearch.h"
+
+#include "fulltext.h"
+
+#define FULLTEXT_HEADER "man-db full-text index 1"
+
+struct fulltext_entry {
+	struct timespec mtime;
+	off_t size;
+	const unsigned char *data;
+	size_t data_len;
+};
+
+struct fulltext_index {
+	char *buf;			/* contents of the index file */
+	struct hashtable *pages;	/* page -> struct fulltext_entry */
+	size_t pages_len;
+};
+
+struct fulltext_query {
+	uint32_t *trigrams;
+	size_t trigrams_len;
+};
+
+static int compare_trigrams (const void *a, const void *b)
+{
+	uint32_t left = *(const uint32_t *) a, right = *(const uint32_t *) b;
+
+	return left < right ? -1 : left > right ? 1 : 0;
+}
+
+/* Return a newly allocated array of the distinct trigrams in the LEN bytes
+ * at TEXT, in ascending order, and set *N to their number.
+ */
+static uint32_t *find_trigrams (const char *text, size_t len, size_t *n)
+{
+	static unsigned char *seen = NULL;	/* one bit per trigram */
+	uint32_t *trigrams = NULL;
+	size_t trigrams_max = 0, i;
+	uint32_t trigram = 0;
+	int run = 0;
+
+	if (!seen)
+		seen = xzalloc (1 << 21);
+
+	*n = 0;
+	for (i = 0; i < len; ++i) {
+		unsigned char c = text[i];
+
+		if (!c || c >= 0x80 || c == '\n') {
+			run = 0;
+			continue;
+		}
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		trigram = ((trigram << 8) | c) & 0xFFFFFF;
+		if (run < 3 && ++run < 3)
+			continue;
+
+		if (seen[trigram >> 3] & (1 << (trigram & 7)))
+			continue;
+		seen[trigram >> 3] |= 1 << (trigram & 7);
+		if (*n >= trigrams_max) {
+			trigrams_max = trigrams_max ? trigrams_max * 2 : 1024;
+			trigrams = xnrealloc (trigrams, trigrams_max,
+					      sizeof *trigrams);
+		}
+		trigrams[(*n)++] = trigram;
+	}
+
+	for (i = 0; i < *n; ++i)
+		seen[trigrams[i] >> 3] = 0;
+	if (trigrams)
+		qsort (trigrams, *n, sizeof *trigrams, compare_trigrams);
+	return trigrams;
+}
+
+static unsigned char *encode_trigrams (const uint32_t *trigrams, size_t n,
+				       size_t *len)
+{
+	unsigned char *data = xmalloc (n * 4 + 1), *p = data;
+	uint32_t prev = 0;
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		uint32_t delta = trigrams[i] - prev;
+
+		prev = trigrams[i];
+		while (delta >= 0x80) {
+			*p++ = (delta & 0x7F) | 0x80;
+			delta >>= 7;
+		}
+		*p++ = delta;
+	}
+
+	*len = p - data;
+	return data;
+}
+
+/* Return non-zero if the encoded trigrams in DATA include all of the
+ * N_WANT trigrams in WANT, which are in ascending order.
+ */
+static int contains_trigrams (const unsigned char *data, size_t len,
+			      const uint32_t *want, size_t n_want)
+{
+	const unsigned char *p = data, *end = data + len;
+	uint32_t trigram = 0;
+	size_t i = 0;
+
+	while (i < n_want) {
+		uint32_t delta = 0;
+		int shift = 0;
+
+		do {
+			if (p == end)
+				return 0;
+			if (shift > 28)
+				return 1;	/* corrupt; be safe */
+			delta |= (uint32_t) (*p & 0x7F) << shift;
+			shift += 7;
+		} while (*p++ & 0x80);
+		trigram += delta;
+
+		if (want[i] < trigram)
+			return 0;
+		if (want[i] == trigram)
+			++i;
+	}
+
+	return 1;
+}
+
+static int compare_names (const void *a, const void *b)
+{
+	return strcmp (*(char * const *) a, *(char * const *) b);
+}
+
+/* Set *NAMESP to a sorted, newly allocated array of the names in PATH (or
+ * only of the manual page section directories in it if SECTIONS_ONLY is
+ * set), and *NAMES_LEN to their number.
+ */
+static void list_names (const char *path, int sections_only,
+			char ***namesp, size_t *names_len)
+{
+	DIR *dir;
+	struct dirent *ent;
+	size_t names_max = 0;
+
+	*namesp = NULL;
+	*names_len = 0;
+	dir = opendir (path);
+	if (!dir)
+		return;
+	while ((ent = readdir (dir)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+		if (sections_only && !STRNEQ (ent->d_name, "man", 3))
+			continue;
+		if (strpbrk (ent->d_name, "\t\n"))
+			continue;
+		if (*names_len >= names_max) {
+			names_max = names_max ? names_max * 2 : 64;
+			*namesp = xnrealloc (*namesp, names_max,
+					     sizeof **namesp);
+		}
+		(*namesp)[(*names_len)++] = xstrdup (ent->d_name);
+	}
+	closedir (dir);
+
+	if (*namesp)
+		qsort (*namesp, *names_len, sizeof **namesp, &compare_names);
+}
+
+/* Bring the full-text index FILE for MANPATH up to date, indexing again
+ * only those pages that have changed since it was written.  Return 0 on
+ * success or -1 on error, with errno set.
+ */
+int fulltext_update (const char *manpath, const char *file)
+{
+	struct fulltext_index *old = fulltext_load (file);
+	char *tmpfile;
+	FILE *fp;
+	char **sections;
+	size_t sections_len, pages_len = 0, indexed = 0, i, j;
+	int saved_errno;
+
+	tmpfile = xasprintf ("%s.%d", file, getpid ());
+	fp = fopen (tmpfile, "w");
+	if (!fp) {
+		saved_errno = errno;
+		free (tmpfile);
+		fulltext_free (old);
+		errno = saved_errno;
+		return -1;
+	}
+	fputs (FULLTEXT_HEADER "\n", fp);
+
+	list_names (manpath, 1, &sections, &sections_len);
+	for (i = 0; i < sections_len; ++i) {
+		char *dir = xasprintf ("%s/%s", manpath, sections[i]);
+		char **names;
+		size_t names_len;
+
+		list_names (dir, 0, &names, &names_len);
+		for (j = 0; j < names_len; ++j) {
+			char *page = xasprintf ("%s/%s", sections[i], names[j]);
+			char *path = xasprintf ("%s/%s", dir, names[j]);
+			const struct fulltext_entry *entry = NULL;
+			struct timespec mtime;
+			unsigned char *data = NULL;
+			const unsigned char *out;
+			size_t data_len;
+			struct stat st;
+
+			if (stat (path, &st) < 0 || !S_ISREG (st.st_mode))
+				goto next;
+			mtime = get_stat_mtime (&st);
+
+			if (old)
+				entry = hashtable_lookup (old->pages, page,
+							  strlen (page));
+			if (entry && entry->size == st.st_size &&
+			    timespec_cmp (entry->mtime, mtime) == 0) {
+				out = entry->data;
+				data_len = entry->data_len;
+			} else {
+				size_t len, n;
+				char *text = decompress_read_file (path, &len);
+				uint32_t *trigrams;
+
+				if (!text)
+					goto next;
+				trigrams = find_trigrams (text, len, &n);
+				data = encode_trigrams (trigrams, n,
+							&data_len);
+				free (trigrams);
+				free (text);
+				out = data;
+				++indexed;
+				debug ("indexed %s: %zu trigrams\n", page, n);
+			}
+
+			fprintf (fp, "%s\t%ld\t%ld\t%lld\t%lu\n", page,
+				 (long) mtime.tv_sec, (long) mtime.tv_nsec,
+				 (long long) st.st_size,
+				 (unsigned long) data_len);
+			fwrite (out, 1, data_len, fp);
+			++pages_len;
+next:
+			free (data);
+			free (path);
+			free (page);
+			free (names[j]);
+		}
+		free (names);
+		free (dir);
+		free (sections[i]);
+	}
+	free (sections);
+
+	if (old && !indexed && old->pages_len == pages_len) {
+		debug ("full-text index %s is up to date\n", file);
+		fclose (fp);
+		unlink (tmpfile);
+		free (tmpfile);
+		fulltext_free (old);
+		return 0;
+	}
+	fulltext_free (old);
+
+	if (ferror (fp) || fclose (fp) != 0 || rename (tmpfile, file) < 0) {
+		saved_errno = errno;
+		unlink (tmpfile);
+		free (tmpfile);
+		errno = saved_errno;
+		return -1;
+	}
+	chmod (file, DBMODE);
+
+	debug ("wrote full-text index %s for %s (%zu of %zu pages indexed)\n",
+	       file, manpath, indexed, pages_len);
+	free (tmpfile);
+	return 0;
+}
+
+/* Load the full-text index FILE.  Return NULL if it does not exist or
+ * cannot be read.
+ */
+struct fulltext_index *fulltext_load (const char *file)
+{
+	struct fulltext_index *index;
+	FILE *fp;
+	struct stat st;
+	char *p, *end;
+
+	fp = fopen (file, "r");
+	if (!fp)
+		return NULL;
+	if (fstat (fileno (fp), &st) < 0) {
+		fclose (fp);
+		return NULL;
+	}
+
+	index = XZALLOC (struct fulltext_index);
+	index->buf = xmalloc (st.st_size + 1);
+	if (fread (index->buf, 1, st.st_size, fp) != (size_t) st.st_size) {
+		fclose (fp);
+		goto corrupt;
+	}
+	fclose (fp);
+	index->buf[st.st_size] = '\0';
+	index->pages = hashtable_create (&plain_hashtable_free);
+
+	p = index->buf;
+	end = index->buf + st.st_size;
+	if (!STRNEQ (p, FULLTEXT_HEADER "\n", strlen (FULLTEXT_HEADER) + 1))
+		goto corrupt;
+	p += strlen (FULLTEXT_HEADER) + 1;
+
+	while (p < end) {
+		struct fulltext_entry *entry;
+		char *newline = memchr (p, '\n', end - p);
+		char *page = p, *field;
+		long sec, nsec;
+		long long size;
+		unsigned long data_len;
+
+		if (!newline)
+			goto corrupt;
+		*newline = '\0';
+
+		field = strchr (page, '\t');
+		if (!field)
+			goto corrupt;
+		*field++ = '\0';
+		if (sscanf (field, "%ld\t%ld\t%lld\t%lu",
+			    &sec, &nsec, &size, &data_len) != 4 ||
+		    data_len > (unsigned long) (end - newline - 1))
+			goto corrupt;
+
+		entry = XMALLOC (struct fulltext_entry);
+		entry->mtime.tv_sec = sec;
+		entry->mtime.tv_nsec = nsec;
+		entry->size = size;
+		entry->data = (const unsigned char *) newline + 1;
+		entry->data_len = data_len;
+		hashtable_install (index->pages, page, strlen (page), entry);
+		++index->pages_len;
+
+		p = newline + 1 + entry->data_len;
+	}
+
+	debug ("loaded full-text index %s (%zu pages)\n",
+	       file, index->pages_len);
+	return index;
+
+corrupt:
+	debug ("full-text index %s is corrupt; ignoring it\n", file);
+	fulltext_free (index);
+	return NULL;
+}
+
+void fulltext_free (struct fulltext_index *index)
+{
+	if (!index)
+		return;
+	if (index->pages)
+		hashtable_free (index->pages);
+	free (index->buf);
+	free (index);
+}
+
+/* Prepare to look up PATTERN, which is an extended regular expression if
+ * REGEX is set or a plain string otherwise.  Return NULL if the index
+ * cannot help to find it.
+ */
+struct fulltext_query *fulltext_query_new (const char *pattern, int regex)
+{
+	struct fulltext_query *query;
+	char *literal = regex ? strsearch_regex_literal (pattern)
+			      : xstrdup (pattern);
+	uint32_t *trigrams;
+	size_t n;
+
+	if (!literal)
+		return NULL;
+	trigrams = find_trigrams (literal, strlen (literal), &n);
+	if (!n) {
+		free (trigrams);
+		free (literal);
+		return NULL;
+	}
+	debug ("full-text query \"%s\": %zu trigrams\n", literal, n);
+	free (literal);
+
+	query = XMALLOC (struct fulltext_query);
+	query->trigrams = trigrams;
+	query->trigrams_len = n;
+	return query;
+}
+
+void fulltext_query_free (struct fulltext_query *query)
+{
+	if (!query)
+		return;
+	free (query->trigrams);
+	free (query);
+}
+
+/* Return zero if INDEX shows that the page PAGE (relative to the top of
+ * the hierarchy), with status ST, cannot match QUERY; otherwise it needs
+ * to be searched.
+ */
+int fulltext_may_match (const struct fulltext_index *index,
+			const struct fulltext_query *query,
+			const char *page, const struct stat *st)
+{
+	const struct fulltext_entry *entry;
+
+	entry = hashtable_lookup (index->pages, page, strlen (page));
+	if (!entry || entry->size != st->st_size ||
+	    timespec_cmp (entry->mtime, get_stat_mtime (st)) != 0)
+		return 1;
+	return contains_trigrams (entry->data, entry->data_len,
+				  query->trigrams, query->trigrams_len);
+}
@@ -0,0 +1,39 @@
+/*
+ * fulltext.h: interface to the full-text index used by man -K
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+struct fulltext_index;
+struct fulltext_query;
+
+extern int fulltext_update (const char *manpath, const char *file);
+
+extern struct fulltext_index *fulltext_load (const char *file);
+extern void fulltext_free (struct fulltext_index *index);
+
+extern struct fulltext_query *fulltext_query_new (const char *pattern,
+						  int regex);
+extern void fulltext_query_free (struct fulltext_query *query);
+extern int fulltext_may_match (const struct fulltext_index *index,
+			       const struct fulltext_query *query,
+			       const char *page, const struct stat *st);
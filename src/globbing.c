@@ -43,6 +43,7 @@
 #include "error.h"
 #include "hashtable.h"
 #include "cleanup.h"
+#include "manifest.h"
 #include "xregcomp.h"
 
 #include "globbing.h"
@@ -154,13 +155,23 @@ static struct dirent_hashent *update_directory_cache (const char *path)
 
 	debug ("update_directory_cache %s: miss\n", path);
 
+	cache = XMALLOC (struct dirent_hashent);
+
+	/* A fresh manifest saves reading the directory. */
+	if (manifest_list_directory (path, &cache->names,
+				     &cache->names_len) == 0) {
+		debug ("update_directory_cache %s: using manifest\n", path);
+		cache->names_max = cache->names_len;
+		goto sort;
+	}
+
 	dir = opendir (path);
 	if (!dir) {
 		debug_error ("can't open directory %s", path);
+		free (cache);
 		return NULL;
 	}
 
-	cache = XMALLOC (struct dirent_hashent);
 	cache->names_len = 0;
 	cache->names_max = 1024;
 	cache->names = XNMALLOC (cache->names_max, char *);
@@ -175,12 +186,13 @@ static struct dirent_hashent *update_directory_cache (const char *path)
 		}
 		cache->names[cache->names_len++] = xstrdup (entry->d_name);
 	}
+	closedir (dir);
 
+sort:
 	qsort (cache->names, cache->names_len, sizeof *cache->names,
 	       &cache_compare);
 
 	hashtable_install (dirent_hash, path, strlen (path), cache);
-	closedir (dir);
 
 	return cache;
 }
@@ -304,6 +316,42 @@ static void match_in_directory (const char *path, const char *pattern, int opts,
 	return;
 }
 
+/* Check whether the directory PATH contains an entry called exactly NAME,
+ * using the directory cache rather than stat()ing the file.  Returns 1 if
+ * so, 0 if not, or -1 if the directory could not be read (in which case
+ * the caller should check the file system directly).
+ */
+int directory_has_entry (const char *path, const char *name)
+{
+	struct dirent_hashent *cache;
+	struct pattern_bsearch key;
+	char **found, **end;
+
+	cache = update_directory_cache (path);
+	if (!cache)
+		return -1;
+
+	/* Include the terminating NUL so that only whole names match. */
+	key.pattern = (char *) name;
+	key.len = strlen (name) + 1;
+	found = bsearch (&key, cache->names, cache->names_len,
+			 sizeof *cache->names, &pattern_compare);
+	if (!found)
+		return 0;
+
+	/* The cache is sorted case-insensitively, so there may be several
+	 * candidates adjacent to the one bsearch() found.
+	 */
+	while (found > cache->names && !strcasecmp (name, *(found - 1)))
+		--found;
+	end = cache->names + cache->names_len;
+	for (; found < end && !strcasecmp (name, *found); ++found)
+		if (STREQ (name, *found))
+			return 1;
+
+	return 0;
+}
+
 char **look_for_file (const char *hier, const char *sec,
 		      const char *unesc_name, int cat, int opts)
 {
@@ -30,5 +30,8 @@ enum look_for_file_opts {
 extern char **look_for_file (const char *hier, const char *sec,
 			     const char *unesc_name, int cat, int opts);
 
+/* Check for an entry in a directory using the directory cache. */
+extern int directory_has_entry (const char *path, const char *name);
+
 /* Expand path with wildcards into list of all existing directories. */
 extern char **expand_path (const char *path);
@@ -47,12 +47,14 @@
 #include "security.h"
 
 #include "descriptions.h"
+#include "fragments.h"
 #include "ult_src.h"
 
 char *program_name;
 int quiet = 1;
 
 static int parse_man = 0, parse_cat = 0, show_whatis = 0, show_filters = 0;
+static int show_fragment = 0;
 static const char *encoding = NULL;
 static char **files;
 static int num_files;
@@ -70,6 +72,7 @@ static struct argp_option options[] = {
 	{ "cat",	'c',	0,		0,	N_("parse as cat page") },
 	{ "whatis",	'w',	0,		0,	N_("show whatis information"),				2 },
 	{ "filters",	'f',	0,		0,	N_("show guessed series of preprocessing filters") },
+	{ "fragment",	'F',	0,		0,	N_("write a whatis fragment for use by mandb") },
 	{ "encoding",	'E',	N_("ENCODING"),	0,	N_("use selected output encoding"),			3 },
 	{ 0, 'h', 0, OPTION_HIDDEN, 0 }, /* compatibility for --help */
 	{ 0 }
@@ -93,6 +96,9 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 		case 'f':
 			show_filters = 1;
 			return 0;
+		case 'F':
+			show_fragment = 1;
+			return 0;
 		case 'E':
 			encoding = arg;
 			return 0;
@@ -119,7 +125,11 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 			/* defaults: --man, --whatis */
 			if (!parse_man && !parse_cat)
 				parse_man = 1;
-			if (!show_whatis && !show_filters)
+			if (show_fragment && parse_cat)
+				argp_error (state,
+					    _("%s: incompatible options"),
+					    "-c -F");
+			if (!show_whatis && !show_filters && !show_fragment)
 				show_whatis = 1;
 			return 0;
 	}
@@ -155,18 +165,31 @@ int main (int argc, char **argv)
 	else
 		type = 1;
 
+	if (show_fragment)
+		printf ("man-db whatis fragment 1\n");
+
 	for (i = 0; i < num_files; ++i) {
 		lexgrog lg;
 		const char *file;
+		char *path = NULL;
+		struct stat statbuf;
+		struct ult_trace trace;
 		int found = 0;
 
+		memset (&lg, 0, sizeof lg);
 		lg.type = type;
+		memset (&trace, 0, sizeof trace);
 
-		if (STREQ (files[i], "-"))
+		if (STREQ (files[i], "-")) {
+			if (show_fragment) {
+				error (0, 0, _("can't write a whatis fragment "
+					       "for standard input"));
+				some_failed = 1;
+				continue;
+			}
 			file = files[i];
-		else {
-			char *path, *pathend;
-			struct stat statbuf;
+		} else {
+			char *pathend;
 
 			path = xstrdup (files[i]);
 			pathend = strrchr (path, '/');
@@ -185,12 +208,21 @@ int main (int argc, char **argv)
 			}
 
 			file = ult_src (files[i], path ? path : ".",
-					&statbuf, SO_LINK, NULL);
-			if (path)
-				free (path);
+					&statbuf, SO_LINK,
+					show_fragment ? &trace : NULL);
 		}
 
-		if (file && find_name (file, "-", &lg, encoding)) {
+		if (show_fragment) {
+			if (file && stat (files[i], &statbuf) == 0 &&
+			    find_name (file, "-", &lg, encoding) && lg.whatis) {
+				fragment_print (stdout, path ? path : ".",
+						files[i], &statbuf, lg.filters,
+						&trace, lg.whatis);
+				found = 1;
+			}
+			free (lg.filters);
+			free (lg.whatis);
+		} else if (file && find_name (file, "-", &lg, encoding)) {
 			struct page_description *descs =
 				parse_descriptions (NULL, lg.whatis);
 			const struct page_description *desc;
@@ -212,9 +244,16 @@ int main (int argc, char **argv)
 		}
 
 		if (!found) {
-			printf ("%s: parse failed\n", files[i]);
+			if (show_fragment)
+				error (0, 0, _("%s: parse failed"), files[i]);
+			else
+				printf ("%s: parse failed\n", files[i]);
 			some_failed = 1;
 		}
+
+		if (trace.names)
+			free_ult_trace (&trace);
+		free (path);
 	}
 
 	if (some_failed)
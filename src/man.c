@@ -68,6 +68,11 @@ int have_cwd;
 #include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+
+#ifdef HAVE_LIBZ
+#  include "zlib.h"
+#endif /* HAVE_LIBZ */
 
 #include "argp.h"
 #include "dirname.h"
@@ -97,16 +102,21 @@ int have_cwd;
 #include "security.h"
 #include "encodings.h"
 #include "orderfiles.h"
+#include "strsearch.h"
 
 #include "mydbm.h"
 #include "db_storage.h"
 
+#include "check_mandirs.h"
 #include "filenames.h"
+#include "fulltext.h"
 #include "globbing.h"
 #include "ult_src.h"
 #include "manp.h"
 #include "zsoelim.h"
 #include "manconv_client.h"
+#include "render_cache.h"
+#include "cat_store.h"
 
 #ifdef SECURE_MAN_UID
 extern uid_t ruid;
@@ -194,6 +204,8 @@ extern const char *extension; /* for globbing.c */
 extern char *user_config_file;	/* defined in manp.c */
 extern int disable_cache;
 extern int min_cat_width, max_cat_width, cat_width;
+extern int render_cache_size;
+extern int stale_cats;
 
 /* locals */
 static const char *alt_system_name;
@@ -210,6 +222,7 @@ static const char *std_sections[] = STD_SECTIONS;
 static char *manp;
 static const char *external;
 static struct hashtable *db_hash = NULL;
+static struct hashtable *dbf_hash = NULL;
 
 static int troff;
 static const char *roff_device = NULL;
@@ -244,6 +257,8 @@ static int found_a_stray;		/* found a straycat */
 #ifdef MAN_CATS
 static char *tmp_cat_file;	/* for open_cat_stream(), close_cat_stream() */
 static int created_tmp_cat;			/* dto. */
+static int prefetching;		/* formatting the next page for man -a */
+static pid_t prefetch_pid;
 #endif
 static int tmp_cat_fd;
 static struct timespec man_modtime;	/* modtime of man page, for
@@ -1513,48 +1528,85 @@ static void add_output_iconv (pipeline *p,
 
 /* Pipeline command to squeeze multiple blank lines into one.
  *
+ * Every line of every page displayed goes through here, so read large
+ * blocks, find lines with memchr(), and write runs of non-blank lines
+ * straight from the input buffer rather than handling lines one at a time.
  */
 static void squeeze_blank_lines (void *data ATTRIBUTE_UNUSED)
 {
-	char *line = NULL;
-	size_t len = 0;
-
-	while (getline (&line, &len, stdin) != -1) {
-		int in_blank_line  = 1;
-		int got_blank_line = 0;
-
-		while (in_blank_line) {
-			char *p;
-			for (p = line; *p; ++p) {
-				if (!CTYPE (isspace, *p)) {
-					in_blank_line = 0;
-					break;
-				}
-			}
+	size_t size = 65536, len = 0;
+	char *buf = xmalloc (size);
+	char is_space[UCHAR_MAX + 1];
+	int got_blank_line = 0, eof = 0;
+	int i;
+
+	for (i = 0; i <= UCHAR_MAX; ++i)
+		is_space[i] = CTYPE (isspace, i) ? 1 : 0;
+
+	while (!eof) {
+		const char *p = buf, *span = buf, *end;
+		ssize_t n;
 
-			if (in_blank_line) {
+		/* Unlike fread(), read() hands over whatever is available,
+		 * so the pager still sees output as soon as it is formatted.
+		 */
+		do
+			n = read (STDIN_FILENO, buf + len, size - len);
+		while (n < 0 && errno == EINTR);
+		if (n <= 0)
+			eof = 1;
+		else
+			len += n;
+		end = buf + len;
+
+		while (p < end) {
+			const char *nl = memchr (p, '\n', end - p);
+			const char *next, *q;
+
+			if (nl)
+				next = nl + 1;
+			else if (eof)
+				next = end;
+			else
+				break;	/* incomplete line */
+
+			for (q = p; q < next && is_space[(unsigned char) *q];
+			     ++q)
+				;
+			if (q == next) {
+				/* Blank line: write out what came before. */
+				if (p > span &&
+				    fwrite (span, 1, p - span, stdout) <
+						(size_t) (p - span))
+					goto out;
 				got_blank_line = 1;
-				free (line);
-				line = NULL;
-				len  = 0;
-				if (getline (&line, &len, stdin) == -1)
-					break;
+				span = next;
+			} else if (got_blank_line) {
+				if (putchar ('\n') < 0)
+					goto out;
+				got_blank_line = 0;
 			}
+			p = next;
 		}
 
-		if (got_blank_line && putchar ('\n') < 0)
-			break;
-
-		if (!in_blank_line && fputs (line, stdout) < 0)
-			break;
+		if (p > span &&
+		    fwrite (span, 1, p - span, stdout) < (size_t) (p - span))
+			goto out;
 
-		free (line);
-		line = NULL;
-		len  = 0;
+		/* Keep any incomplete line for next time. */
+		len = end - p;
+		memmove (buf, p, len);
+		if (len == size) {
+			size *= 2;
+			buf = xrealloc (buf, size);
+		}
 	}
 
-	free (line);
-	return;
+	if (got_blank_line)
+		putchar ('\n');
+
+out:
+	free (buf);
 }
 
 /* Return pipeline to display file provided on stdin.
@@ -1742,6 +1794,99 @@ static void maybe_discard_stderr (pipeline *p)
 		discard_stderr (p);
 }
 
+#ifdef COMP_CAT
+
+#  ifdef HAVE_LIBZ
+
+/* If COMPRESSOR is just gzip writing to standard output, return the
+ * compression level it would use; otherwise return 0.
+ */
+static int gzip_level (const char *compressor)
+{
+	char *copy = xstrdup (compressor);
+	char *word, *base;
+	int level = 6, ret = 0;
+
+	word = strtok (copy, " \t");
+	if (!word)
+		goto out;
+	base = strrchr (word, '/');
+	if (!STREQ (base ? base + 1 : word, "gzip"))
+		goto out;
+	while ((word = strtok (NULL, " \t")) != NULL) {
+		const char *opt;
+
+		if (*word != '-' || !word[1])
+			goto out;
+		for (opt = word + 1; *opt; ++opt) {
+			if (*opt >= '1' && *opt <= '9')
+				level = *opt - '0';
+			else if (*opt != 'c' && *opt != 'n')
+				goto out;
+		}
+	}
+	ret = level;
+
+out:
+	free (copy);
+	return ret;
+}
+
+static void compress_zlib (void *data)
+{
+	const int *level = data;
+	char mode[3];
+	gzFile zlibfile;
+
+	mode[0] = 'w';
+	mode[1] = '0' + *level;
+	mode[2] = '\0';
+	zlibfile = gzdopen (dup (STDOUT_FILENO), mode);
+	if (!zlibfile)
+		exit (FATAL);
+
+	for (;;) {
+		char buffer[4096];
+		size_t r = fread (buffer, 1, sizeof buffer, stdin);
+		if (r == 0)
+			break;
+		if (gzwrite (zlibfile, buffer, r) != (int) r) {
+			gzclose (zlibfile);
+			exit (FATAL);
+		}
+	}
+
+	if (gzclose (zlibfile) != Z_OK)
+		exit (FATAL);
+}
+
+#  endif /* HAVE_LIBZ */
+
+/* Return a command to compress cat pages.  catman may save tens of
+ * thousands of them in one run, so if the compressor is gzip then do the
+ * job with zlib rather than executing gzip for every page.
+ */
+static pipecmd *compressor_command (void)
+{
+	const char *compressor = get_def ("compressor", COMPRESSOR);
+#  ifdef HAVE_LIBZ
+	int level = gzip_level (compressor);
+
+	if (level) {
+		int *data = xmalloc (sizeof *data);
+
+		*data = level;
+		/* informational only; no shell quoting concerns */
+		return pipecmd_new_function (compressor, &compress_zlib,
+					     &free, data);
+	}
+#  endif /* HAVE_LIBZ */
+
+	return pipecmd_new_argstr (compressor);
+}
+
+#endif /* COMP_CAT */
+
 #ifdef MAN_CATS
 
 /* Return pipeline to write formatted manual page to for saving as cat file. */
@@ -1780,7 +1925,7 @@ static pipeline *open_cat_stream (const char *cat_file, const char *encoding)
 	add_output_iconv (cat_p, encoding, "UTF-8");
 #  ifdef COMP_CAT
 	/* fork the compressor */
-	comp_cmd = pipecmd_new_argstr (get_def ("compressor", COMPRESSOR));
+	comp_cmd = compressor_command ();
 	pipecmd_nice (comp_cmd, 10);
 	pipeline_command (cat_p, comp_cmd);
 #  endif
@@ -1989,11 +2134,16 @@ static void display_catman (const char *cat_file, pipeline *decomp,
 	char *tmpcat = tmp_cat_filename (cat_file);
 	int status;
 
+	if (!tmpcat) {
+		error (0, errno, _("can't create temporary cat for %s"),
+		       cat_file);
+		return;
+	}
+
 	add_output_iconv (format_cmd, encoding, "UTF-8");
 
 #ifdef COMP_CAT
-	pipeline_command_argstr (format_cmd,
-				 get_def ("compressor", COMPRESSOR));
+	pipeline_command (format_cmd, compressor_command ());
 #endif /* COMP_CAT */
 
 	maybe_discard_stderr (format_cmd);
@@ -2068,6 +2218,38 @@ static void locale_macros (void *data)
 }
 #endif /* TROFF_IS_GROFF */
 
+/* Extra roff input to go in front of the page.  A single function command
+ * writes all of it, rather than one for each piece, since each function
+ * command costs a process.
+ */
+struct roff_prelude {
+	int no_hyphenation;
+	int no_justification;
+	char *macro_lang;	/* per-locale macros to load, or NULL */
+};
+
+static void roff_prelude_free (void *data)
+{
+	struct roff_prelude *prelude = data;
+
+	free (prelude->macro_lang);
+	free (prelude);
+}
+
+static void roff_prelude (void *data)
+{
+	struct roff_prelude *prelude = data;
+
+	if (prelude->no_hyphenation)
+		disable_hyphenation (NULL);
+	if (prelude->no_justification)
+		disable_justification (NULL);
+#ifdef TROFF_IS_GROFF
+	if (prelude->macro_lang)
+		locale_macros (prelude->macro_lang);
+#endif /* TROFF_IS_GROFF */
+}
+
 /* allow user to skip a page or quit after viewing desired page 
    return 1 to skip
    return 0 to view
@@ -2109,6 +2291,351 @@ static int do_prompt (const char *name)
 	return 0;
 }
 
+/* Return a pipeline to decompress MAN_FILE, or standard input if MAN_FILE
+ * is "", adding any extra roff input needed for the current settings.
+ */
+static pipeline *open_source (const char *man_file)
+{
+	pipeline *decomp;
+	struct roff_prelude *prelude = XZALLOC (struct roff_prelude);
+	char *name = NULL;
+
+	if (*man_file)
+		decomp = decompress_open (man_file);
+	else
+		decomp = decompress_fdopen (dup (STDIN_FILENO));
+
+	if (!recode && no_hyphenation) {
+		prelude->no_hyphenation = 1;
+		name = appendstr (name, "echo .nh && echo .de hy && echo ..",
+				  NULL);
+	}
+
+	if (!recode && no_justification) {
+		prelude->no_justification = 1;
+		name = appendstr (name, name ? " && " : "",
+				  "echo .na && echo .de ad && echo ..", NULL);
+	}
+
+#ifdef TROFF_IS_GROFF
+	/* This only works with preconv, since the per-locale macros
+	 * may change the assumed input encoding.
+	 */
+	if (!recode && *man_file && get_groff_preconv ()) {
+		char *page_lang = lang_dir (man_file);
+
+		if (page_lang && *page_lang &&
+		    !STREQ (page_lang, "C")) {
+			struct locale_bits bits;
+
+			unpack_locale_bits (page_lang, &bits);
+			name = appendstr (name, name ? " && " : "",
+					  "echo .mso ", bits.language, ".tmac",
+					  NULL);
+			prelude->macro_lang = page_lang;
+			free_locale_bits (&bits);
+		} else
+			free (page_lang);
+	}
+#endif /* TROFF_IS_GROFF */
+
+	if (name) {
+		pipecmd *seq = pipecmd_new_sequence
+			("decompressor",
+			 pipecmd_new_function (name, roff_prelude,
+					       roff_prelude_free, prelude),
+			 NULL);
+
+		assert (pipeline_get_ncommands (decomp) <= 1);
+		if (pipeline_get_ncommands (decomp)) {
+			pipecmd_sequence_command
+				(seq,
+				 pipeline_get_command (decomp, 0));
+			pipeline_set_command (decomp, 0, seq);
+		} else {
+			pipecmd_sequence_command
+				(seq, pipecmd_new_passthrough ());
+			pipeline_command (decomp, seq);
+		}
+		free (name);
+	} else
+		roff_prelude_free (prelude);
+
+	return decomp;
+}
+
+#ifdef MAN_CATS
+/* Is formatted output of a kind that could be cached? */
+static int cacheable_output (void)
+{
+	if (troff || want_encoding || recode || local_man_file ||
+	    disable_cache || print_where || print_where_cat)
+		return 0;
+#ifdef TROFF_IS_GROFF
+	if (htmlout)
+		return 0;
+#endif /* TROFF_IS_GROFF */
+	return 1;
+}
+
+/* Do the current settings produce the same output as ordinary cat pages? */
+static int standard_cat_settings (void)
+{
+	int term_width = get_line_length ();
+
+	return term_width >= min_cat_width && term_width <= max_cat_width &&
+	       !preprocessors && !no_hyphenation && !no_justification;
+}
+
+/* Return the key under which a rendering of MAN_FILE in DIR would be kept
+ * in the render cache, or NULL if the render cache does not apply: either
+ * ordinary cat pages already cover the current settings, or the output is
+ * not going to a pager at all.  The key must include everything that
+ * affects the formatted output other than the page's own contents.
+ */
+static char *render_cache_key (const char *dir, const char *man_file,
+			       const char *cat_file, const char *dbfilters)
+{
+	const char *roffseq = getenv ("MANROFFSEQ");
+	const char *roffopt = getenv ("MANROFFOPT");
+	struct stat st;
+	struct timespec mtime;
+	int term_width, line_length;
+	char *source, *key;
+
+	if (!man_file || !*man_file || !cat_file || render_cache_size <= 0)
+		return NULL;
+	if (catman || !cacheable_output () || standard_cat_settings ())
+		return NULL;
+
+	term_width = get_line_length ();
+
+	if (stat (man_file, &st))
+		return NULL;
+	mtime = get_stat_mtime (&st);
+	line_length = cat_width ? cat_width : term_width;
+
+	if (*man_file == '/' || !dir)
+		source = xstrdup (man_file);
+	else
+		source = xasprintf ("%s/%s", dir, man_file);
+
+	key = xasprintf ("%s\n%ld.%09ld\n%d\n%s\n%s\n%s\n%s\n%s\n%s\n%d %d",
+			 source, (long) mtime.tv_sec, (long) mtime.tv_nsec,
+			 line_length, roff_device ? roff_device : "",
+			 my_locale_charset (),
+			 preprocessors ? preprocessors : "",
+			 dbfilters ? dbfilters : "", roffseq ? roffseq : "",
+			 roffopt ? roffopt : "",
+			 no_hyphenation, no_justification);
+	free (source);
+	return key;
+}
+
+/* Return the settings other than the source that go into the name of a
+ * page in the cat store.
+ */
+static char *cat_store_params (const char *man_file ATTRIBUTE_UNUSED,
+				const char *dbfilters)
+{
+	const char *roffseq = getenv ("MANROFFSEQ");
+	char *page_lang = NULL, *params;
+
+#ifdef TROFF_IS_GROFF
+	/* Per-locale macros are only used with preconv; see open_source(). */
+	if (get_groff_preconv ())
+		page_lang = lang_dir (man_file);
+#endif /* TROFF_IS_GROFF */
+
+	params = xasprintf ("%d\n%s\n%s\n%s\n%s\n%s",
+			    cat_width ? cat_width : get_line_length (),
+			    roff_device ? roff_device : "",
+			    my_locale_charset (),
+			    page_lang ? page_lang : "",
+			    dbfilters ? dbfilters : "", roffseq ? roffseq : "");
+	free (page_lang);
+	return params;
+}
+
+/* If CAT_FILE needs to be (re)formatted from MAN_FILE in DIR, look for the
+ * result in the cat store.  Set *STORE_DIR and *OBJECT to the store and the
+ * name of the page in it, for use by store_cat() once the page is formatted.
+ * Return non-zero if CAT_FILE is now up to date.
+ */
+static int fetch_stored_cat (const char *dir, const char *man_file,
+			     const char *cat_file, const char *dbfilters,
+			     char **store_dir, char **object)
+{
+	int status;
+	char *page_lang, *params;
+	pipeline *source;
+	struct stat man_st;
+
+	if (!man_file || !*man_file || !cat_file)
+		return 0;
+	if (!cacheable_output () || (!catman && !standard_cat_settings ()))
+		return 0;
+
+	status = is_changed (man_file, cat_file);
+	if (status != -2 && (status < 0 || !(status & 1)))
+		return 0;
+
+	page_lang = lang_dir (man_file);
+	*store_dir = cat_store_dir (cat_file, page_lang);
+	free (page_lang);
+	/* Identify the page by what the formatter would read, with .so
+	 * requests resolved just as make_roff_command() resolves them.
+	 */
+	source = decompress_open (man_file);
+	if (!source)
+		return 0;
+	pipeline_command (source,
+			  pipecmd_new_function (ZSOELIM, &zsoelim_stdin,
+						zsoelim_stdin_data_free,
+						zsoelim_stdin_data_new
+							(dir, manpathlist)));
+	discard_stderr (source);
+	params = cat_store_params (man_file, dbfilters);
+	*object = cat_store_object (*store_dir, source, params);
+	free (params);
+	pipeline_free (source);
+	if (!*object)
+		return 0;
+	debug ("cat store object for %s is %s\n", man_file, *object);
+
+	if (debug_level || stat (man_file, &man_st))
+		return 0;
+	return !cat_store_fetch (*object, cat_file, get_stat_mtime (&man_st));
+}
+
+/* Add CAT_FILE, just formatted from MAN_FILE, to the cat store as OBJECT
+ * in STORE_DIR.
+ */
+static void store_cat (const char *man_file, const char *cat_file,
+		       const char *store_dir, const char *object)
+{
+	int status;
+
+	if (!object || debug_level)
+		return;
+	/* Only if the cat page was actually saved. */
+	status = is_changed (man_file, cat_file);
+	if (status < 0 || (status & 1) || (status & 4))
+		return;
+	if (!create_cache_dir (store_dir, global_manpath))
+		cat_store_add (object, cat_file);
+}
+
+/* Should the existing but out-of-date CAT_FILE be shown at once while
+ * MAN_FILE is reformatted in the background?  Only if the refresh can
+ * actually replace it; otherwise the stale page would be shown every time.
+ */
+static int use_stale_cat (const char *man_file, const char *cat_file)
+{
+	int status;
+	char *cat_dir, *tmp;
+	int writable;
+
+	if (!stale_cats || !man_file || !*man_file || !cat_file)
+		return 0;
+	if (catman || !cacheable_output () || !standard_cat_settings ())
+		return 0;
+	/* make_roff_command() won't save cat pages formatted with
+	 * pre-processors from the environment.
+	 */
+	if (getenv ("MANROFFSEQ"))
+		return 0;
+
+	status = is_changed (man_file, cat_file);
+	if (status < 0 || !(status & 1) || (status & 4))
+		return 0;
+
+	/* The new cat page is written as the real user. */
+	cat_dir = xstrdup (cat_file);
+	tmp = strrchr (cat_dir, '/');
+	if (tmp)
+		*tmp = 0;
+	writable = !access (tmp ? cat_dir : ".", W_OK);
+	if (!writable)
+		debug ("cat dir %s is not writable\n", cat_dir);
+	free (cat_dir);
+	return writable;
+}
+
+/* Reformat MAN_FILE in DIR and replace CAT_FILE with the result, in a
+ * detached background process so that the caller can carry on displaying
+ * the old cat page.  The formatter runs with privileges dropped, just as
+ * in the foreground, and the new cat page is renamed into place.
+ */
+static void refresh_cat_in_background (const char *dir, const char *man_file,
+				       const char *cat_file,
+				       const char *dbfilters,
+				       const char *store_dir,
+				       const char *object)
+{
+	pid_t pid;
+	int status;
+	pipeline *decomp, *format_cmd;
+	char *formatted_encoding = NULL;
+	int null_fd;
+
+	fflush (NULL);
+	pid = fork ();
+	if (pid < 0) {
+		debug ("can't fork to refresh %s: %s\n",
+		       cat_file, strerror (errno));
+		return;
+	} else if (pid > 0) {
+		/* The intermediate child exits straight away, so the
+		 * refresher is never left as a zombie of ours.
+		 */
+		while (waitpid (pid, &status, 0) < 0 && errno == EINTR)
+			;
+		return;
+	}
+
+	/* Intermediate child. */
+	pid = fork ();
+	if (pid != 0)
+		_exit (pid < 0 ? FATAL : OK);
+
+	/* Refresher. */
+	setsid ();
+	null_fd = open ("/dev/null", O_RDWR);
+	if (null_fd >= 0) {
+		dup2 (null_fd, STDIN_FILENO);
+		dup2 (null_fd, STDOUT_FILENO);
+		dup2 (null_fd, STDERR_FILENO);
+		if (null_fd > STDERR_FILENO)
+			close (null_fd);
+	}
+	errno = 0;
+	if (nice (10) == -1 && errno)
+		debug ("can't lower priority: %s\n", strerror (errno));
+
+	decomp = open_source (man_file);
+	if (!decomp)
+		_exit (FATAL);
+	/* For commit_tmp_cat(). */
+	{
+		struct stat stb;
+
+		if (stat (man_file, &stb))
+			_exit (FATAL);
+		man_modtime = get_stat_mtime (&stb);
+	}
+	pipeline_start (decomp);
+	format_cmd = make_roff_command (dir, man_file, decomp, dbfilters,
+					&formatted_encoding);
+	if (save_cat) {
+		display_catman (cat_file, decomp, format_cmd,
+				formatted_encoding);
+		store_cat (man_file, cat_file, store_dir, object);
+	}
+	_exit (OK);
+}
+#endif /* MAN_CATS */
+
 /*
  * optionally chdir to dir, if necessary update cat_file from man_file
  * and display it.  if man_file is NULL cat_file is a stray cat.  If
@@ -2127,6 +2654,9 @@ static int display (const char *dir, const char *man_file,
 	int display_to_stdout;
 	pipeline *decomp = NULL;
 	int decomp_errno = 0;
+	char *render_dir = NULL, *render_file = NULL;
+	char *store_dir = NULL, *cat_object = NULL;
+	int render_hit = 0, cat_ready = 0;
 
 	/* if dir is set chdir to it */
 	if (dir) {
@@ -2138,74 +2668,52 @@ static int display (const char *dir, const char *man_file,
 		}
 	}
 
-	/* define format_cmd */
-	if (man_file) {
-		pipecmd *seq = pipecmd_new_sequence ("decompressor", NULL);
-		int seq_ncmds = 0;
-
-		if (*man_file)
-			decomp = decompress_open (man_file);
-		else
-			decomp = decompress_fdopen (dup (STDIN_FILENO));
-
-		if (!recode && no_hyphenation) {
-			pipecmd *hcmd = pipecmd_new_function (
-				"echo .nh && echo .de hy && echo ..",
-				disable_hyphenation, NULL, NULL);
-			pipecmd_sequence_command (seq, hcmd);
-			++seq_ncmds;
-		}
-
-		if (!recode && no_justification) {
-			pipecmd *jcmd = pipecmd_new_function (
-				"echo .na && echo .de ad && echo ..",
-				disable_justification, NULL, NULL);
-			pipecmd_sequence_command (seq, jcmd);
-			++seq_ncmds;
-		}
-
-#ifdef TROFF_IS_GROFF
-		/* This only works with preconv, since the per-locale macros
-		 * may change the assumed input encoding.
-		 */
-		if (!recode && *man_file && get_groff_preconv ()) {
-			char *page_lang = lang_dir (man_file);
-
-			if (page_lang && *page_lang &&
-			    !STREQ (page_lang, "C")) {
-				struct locale_bits bits;
-				char *name;
-				pipecmd *lcmd;
-
-				unpack_locale_bits (page_lang, &bits);
-				name = xasprintf ("echo .mso %s.tmac",
-						  bits.language);
-				lcmd = pipecmd_new_function (
-					name, locale_macros, free, page_lang);
-				pipecmd_sequence_command (seq, lcmd);
-				++seq_ncmds;
-				free (name);
-				free_locale_bits (&bits);
-			} else
-				free (page_lang);
+#ifdef MAN_CATS
+	/* Look for a page already rendered for these settings before going
+	 * to the trouble of building a formatting pipeline.
+	 */
+	{
+		char *key = render_cache_key (dir, man_file, cat_file,
+					      dbfilters);
+
+		if (key)
+			render_dir = render_cache_dir (cat_file);
+		if (render_dir && (debug_level ||
+				   !create_cache_dir (render_dir,
+						      global_manpath)))
+			render_file = render_cache_file (render_dir, key);
+		free (key);
+
+		if (render_file) {
+			render_hit = !access (render_file, R_OK);
+			debug ("render cache file %s (%s)\n", render_file,
+			       render_hit ? "hit" : "miss");
+			if (render_hit) {
+				if (!debug_level)
+					render_cache_touch (render_file);
+				cat_file = render_file;
+			}
 		}
-#endif /* TROFF_IS_GROFF */
+	}
 
-		if (seq_ncmds) {
-			assert (pipeline_get_ncommands (decomp) <= 1);
-			if (pipeline_get_ncommands (decomp)) {
-				pipecmd_sequence_command
-					(seq,
-					 pipeline_get_command (decomp, 0));
-				pipeline_set_command (decomp, 0, seq);
-			} else {
-				pipecmd_sequence_command
-					(seq, pipecmd_new_passthrough ());
-				pipeline_command (decomp, seq);
-			}
-		} else
-			pipecmd_free (seq);
+	if (!render_file)
+		cat_ready = fetch_stored_cat (dir, man_file, cat_file,
+					      dbfilters, &store_dir,
+					      &cat_object);
+
+	if (!render_file && !cat_ready && !prefetching &&
+	    use_stale_cat (man_file, cat_file)) {
+		debug ("displaying stale cat %s while refreshing it\n",
+		       cat_file);
+		refresh_cat_in_background (dir, man_file, cat_file,
+					   dbfilters, store_dir, cat_object);
+		cat_ready = 1;
 	}
+#endif /* MAN_CATS */
+
+	/* define format_cmd */
+	if (man_file && !render_hit && !cat_ready)
+		decomp = open_source (man_file);
 
 	if (decomp) {
 		pipeline_start (decomp);
@@ -2292,7 +2800,17 @@ static int display (const char *dir, const char *man_file,
 		    || disable_cache)
 			save_cat = 0;
 
-		if (!man_file) {
+		if (render_file) {
+			/* The render cache stands in for the cat page. */
+			save_cat = 0;
+			format = !render_hit;
+		} else if (cat_ready) {
+			/* Linked from the cat store, or being refreshed in
+			 * the background.
+			 */
+			save_cat = 0;
+			format = 0;
+		} else if (!man_file) {
 			/* Stray cat. */
 			assert (cat_file);
 			format = 0;
@@ -2326,6 +2844,10 @@ static int display (const char *dir, const char *man_file,
 			assert (!format_cmd);
 			assert (!decomp);
 			error (0, decomp_errno, _("can't open %s"), man_file);
+			free (render_file);
+			free (render_dir);
+			free (store_dir);
+			free (cat_object);
 			return 0;
 		}
 
@@ -2346,6 +2868,10 @@ static int display (const char *dir, const char *man_file,
 		if (!found) {
 			pipeline_free (format_cmd);
 			pipeline_free (decomp);
+			free (render_file);
+			free (render_dir);
+			free (store_dir);
+			free (cat_object);
 			return found;
 		}
 
@@ -2370,11 +2896,33 @@ static int display (const char *dir, const char *man_file,
 					       _("\ncannot write to "
 						 "%s in catman mode"),
 					       cat_file);
-				else
+				else {
 					display_catman (cat_file, decomp,
 							format_cmd,
 							formatted_encoding);
+#ifdef MAN_CATS
+					store_cat (man_file, cat_file,
+						   store_dir, cat_object);
+#endif /* MAN_CATS */
+				}
+			}
+#ifdef MAN_CATS
+		} else if (prefetching) {
+			/* Just get the page ready for display_pages(). */
+			if (format && save_cat) {
+				display_catman (cat_file, decomp, format_cmd,
+						formatted_encoding);
+				store_cat (man_file, cat_file,
+					   store_dir, cat_object);
+			} else if (format && render_file) {
+				display_catman (render_file, decomp,
+						format_cmd,
+						formatted_encoding);
+				render_cache_prune (render_dir,
+						    (off_t) render_cache_size *
+						    1024);
 			}
+#endif /* MAN_CATS */
 		} else if (format) {
 			/* no cat or out of date */
 			pipeline *disp_cmd;
@@ -2383,6 +2931,10 @@ static int display (const char *dir, const char *man_file,
 				pipeline_free (format_cmd);
 				pipeline_free (decomp);
 				free (formatted_encoding);
+				free (render_file);
+				free (render_dir);
+				free (store_dir);
+				free (cat_object);
 				if (local_man_file)
 					return 1;
 				else
@@ -2401,6 +2953,19 @@ static int display (const char *dir, const char *man_file,
 							 disp_cmd,
 							 cat_file,
 							 formatted_encoding);
+				store_cat (man_file, cat_file,
+					   store_dir, cat_object);
+			} else if (render_file) {
+				format_display_and_save (decomp,
+							 format_cmd,
+							 disp_cmd,
+							 render_file,
+							 formatted_encoding);
+				if (!debug_level)
+					render_cache_prune
+						(render_dir,
+						 (off_t) render_cache_size *
+						 1024);
 			} else 
 #endif /* MAN_CATS */
 				/* don't save cat */
@@ -2417,6 +2982,10 @@ static int display (const char *dir, const char *man_file,
 			if (prompt && do_prompt (title)) {
 				pipeline_free (format_cmd);
 				pipeline_free (decomp);
+				free (render_file);
+				free (render_dir);
+				free (store_dir);
+				free (cat_object);
 				return 0;
 			}
 
@@ -2425,6 +2994,10 @@ static int display (const char *dir, const char *man_file,
 				error (0, errno, _("can't open %s"), cat_file);
 				pipeline_free (format_cmd);
 				pipeline_free (decomp);
+				free (render_file);
+				free (render_dir);
+				free (store_dir);
+				free (cat_object);
 				return 0;
 			}
 			disp_cmd = make_display_command ("UTF-8", title);
@@ -2435,6 +3008,10 @@ static int display (const char *dir, const char *man_file,
 	}
 
 	free (formatted_encoding);
+	free (render_file);
+	free (render_dir);
+	free (store_dir);
+	free (cat_object);
 
 	pipeline_free (format_cmd);
 	pipeline_free (decomp);
@@ -3133,13 +3710,56 @@ out:
 	return found;
 }
 
+/* Database handles are kept open in dbf_hash, indexed by file name, for
+ * as long as man runs, so that each database is opened and has its
+ * version checked only once however many pages are looked up in it.
+ */
+static void dbf_hashtable_free (void *defn)
+{
+	MYDBM_CLOSE ((MYDBM_FILE) defn);
+}
+
+/* Return a read-only handle on the database FILE, or NULL if it cannot be
+ * opened or has the wrong version.  The caller must not close it.
+ */
+static MYDBM_FILE get_db (const char *file)
+{
+	MYDBM_FILE dbf;
+
+	if (!dbf_hash)
+		dbf_hash = hashtable_create (&dbf_hashtable_free);
+	dbf = hashtable_lookup (dbf_hash, file, strlen (file));
+	if (dbf)
+		return dbf;
+
+	dbf = MYDBM_RDOPEN (file);
+	if (dbf && dbver_rd (dbf)) {
+		MYDBM_CLOSE (dbf);
+		dbf = NULL;
+	}
+	if (!dbf)
+		return NULL;
+
+	debug ("Succeeded in opening %s O_RDONLY\n", file);
+	hashtable_install (dbf_hash, file, strlen (file), dbf);
+	return dbf;
+}
+
 #ifdef MAN_DB_UPDATES
+/* Close any handle on the database FILE, because it is about to change. */
+static void release_db (const char *file)
+{
+	if (dbf_hash)
+		hashtable_remove (dbf_hash, file, strlen (file));
+}
+
 /* wrapper to dbdelete which deals with opening/closing the db */
 static void dbdelete_wrapper (const char *page, struct mandata *info)
 {
 	if (!catman) {
 		MYDBM_FILE dbf;
 
+		release_db (database);
 		dbf = MYDBM_RWOPEN (database);
 		if (dbf) {
 			if (dbdelete (dbf, page, info) == 1)
@@ -3286,6 +3906,42 @@ static void db_hashtable_free (void *defn)
 }
 
 #ifdef MAN_DB_UPDATES
+/* Bring the database entries for the page FILE in MANPATH up to date
+ * directly, rather than having mandb copy the whole database to do it.
+ * Return 1 if another process is writing to the database, in which case
+ * the caller should make do with the current entries, or -1 if it cannot
+ * be opened for writing for some other reason (perhaps it belongs to
+ * somebody else), in which case the caller should fall back to running
+ * mandb.
+ */
+static int update_db_in_place (const char *manpath, const char *file)
+{
+	MYDBM_FILE dbf;
+	int save_quiet = quiet;
+
+	release_db (database);
+	dbf = MYDBM_RWOPEN (database);
+	if (!dbf) {
+		debug ("can't open %s for writing: %s\n",
+		       database, strerror (errno));
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 1;
+		return -1;
+	}
+
+	debug ("updating %s in %s\n", file, database);
+	/* Warnings about the page belong to mandb, as before. */
+	if (!debug_level)
+		quiet = 2;
+	update_one_file (dbf, manpath, file);
+	quiet = save_quiet;
+	/* New keys are not in the section index yet. */
+	dbsections_invalidate (dbf);
+	MYDBM_CLOSE (dbf);
+
+	return 0;
+}
+
 static int maybe_update_file (const char *manpath, const char *name,
 			      struct mandata *info)
 {
@@ -3293,7 +3949,7 @@ static int maybe_update_file (const char *manpath, const char *name,
 	char *file;
 	struct stat buf;
 	struct timespec file_mtime;
-	int status;
+	int ret, status;
 
 	if (!update)
 		return 0;
@@ -3321,13 +3977,20 @@ static int maybe_update_file (const char *manpath, const char *name,
 	       file,
 	       (long) info->mtime.tv_sec, info->mtime.tv_nsec,
 	       (long) file_mtime.tv_sec, file_mtime.tv_nsec);
-	status = run_mandb (0, manpath, file);
-	if (status)
-		error (0, 0, _("mandb command failed with exit status %d"),
-		       status);
+	ret = update_db_in_place (manpath, file);
+	if (ret < 0) {
+		status = run_mandb (0, manpath, file);
+		if (status)
+			error (0, 0,
+			       _("mandb command failed with exit status %d"),
+			       status);
+	}
 	free (file);
 
-	return 1;
+	/* If another process is updating the database, it will deal with
+	 * this page, so don't wait for it.
+	 */
+	return ret <= 0;
 }
 #endif /* MAN_DB_UPDATES */
 
@@ -3349,7 +4012,7 @@ static int try_db (const char *manpath, const char *sec, const char *name,
 		   struct candidate **cand_head)
 {
 	struct mandata *loc, *data;
-	char *catpath;
+	char *catpath, *key;
 	int found = 0;
 #ifdef MAN_DB_UPDATES
 	int found_stale = 0;
@@ -3368,20 +4031,14 @@ static int try_db (const char *manpath, const char *sec, const char *name,
 	if (!db_hash)
 		db_hash = hashtable_create (&db_hashtable_free);
 
-	/* Have we looked here already? */
-	data = hashtable_lookup (db_hash, manpath, strlen (manpath));
+	/* Have we looked for this name here already? */
+	key = xasprintf ("%s\t%s\t%s", manpath, section ? section : "", name);
+	data = hashtable_lookup (db_hash, key, strlen (key));
 
 	if (!data) {
-		MYDBM_FILE dbf;
+		MYDBM_FILE dbf = get_db (database);
 
-		dbf = MYDBM_RDOPEN (database);
-		if (dbf && dbver_rd (dbf)) {
-			MYDBM_CLOSE (dbf);
-			dbf = NULL;
-		}
 		if (dbf) {
-			debug ("Succeeded in opening %s O_RDONLY\n", database);
-
 			/* if section is set, only return those that match,
 			   otherwise NULL retrieves all available */
 			if (regex_opt || wildcard)
@@ -3391,10 +4048,7 @@ static int try_db (const char *manpath, const char *sec, const char *name,
 			else
 				data = dblookup_all (dbf, name, section,
 						     match_case);
-			hashtable_install (db_hash, manpath, strlen (manpath),
-					   data);
-			MYDBM_CLOSE (dbf);
-			dbf = NULL;
+			hashtable_install (db_hash, key, strlen (key), data);
 #ifdef MAN_DB_CREATES
 		} else if (!global_manpath) {
 			/* create one */
@@ -3403,11 +4057,12 @@ static int try_db (const char *manpath, const char *sec, const char *name,
 				data = infoalloc ();
 				data->next = NULL;
 				data->addr = NULL;
-				hashtable_install (db_hash,
-						   manpath, strlen (manpath),
+				hashtable_install (db_hash, key, strlen (key),
 						   data);
+				free (key);
 				return TRY_DATABASE_OPEN_FAILED;
 			}
+			free (key);
 			return TRY_DATABASE_CREATED;
 #endif /* MAN_DB_CREATES */
 		} else {
@@ -3415,19 +4070,23 @@ static int try_db (const char *manpath, const char *sec, const char *name,
 			data = infoalloc ();
 			data->next = (struct mandata *) NULL;
 			data->addr = NULL;
-			hashtable_install (db_hash, manpath, strlen (manpath),
-					   data);
+			hashtable_install (db_hash, key, strlen (key), data);
+			free (key);
 			return TRY_DATABASE_OPEN_FAILED;
 		}
 	}
 
 	/* if we already know that there is nothing here, get on with it */
-	if (!data)
+	if (!data) {
+		free (key);
 		return 0;
+	}
 
 	/* We already tried (and failed) to open this db before */
-	if (!data->addr)
+	if (!data->addr) {
+		free (key);
 		return TRY_DATABASE_OPEN_FAILED;
+	}
 
 #ifdef MAN_DB_UPDATES
 	/* Check that all the entries found are up to date. If not, the
@@ -3441,11 +4100,15 @@ static int try_db (const char *manpath, const char *sec, const char *name,
 				found_stale = 1;
 
 	if (found_stale) {
-		hashtable_remove (db_hash, manpath, strlen (manpath));
+		hashtable_remove (db_hash, key, strlen (key));
+		free (key);
+		release_db (database);
 		return TRY_DATABASE_UPDATED;
 	}
 #endif /* MAN_DB_UPDATES */
 
+	free (key);
+
 	/* cycle through the mandata structures (there's usually only 
 	   1 or 2) and see what we have w.r.t. the current section */
 	for (loc = data; loc; loc = loc->next)
@@ -3509,12 +4172,86 @@ static int locate_page (const char *manpath, const char *sec, const char *name,
 	return found;
 }
 
+#ifdef MAN_CATS
+/* Format CANDP into its cat page or the render cache in the background,
+ * so that it is ready by the time that man -a gets to it.
+ */
+static void prefetch_page (struct candidate *candp)
+{
+	int null_fd;
+
+	if (print_where || print_where_cat || catman || troff ||
+	    want_encoding || recode || disable_cache)
+		return;
+#ifdef TROFF_IS_GROFF
+	if (htmlout)
+		return;
+#endif /* TROFF_IS_GROFF */
+
+	/* Work out the line length while we can still see the terminal. */
+	get_line_length ();
+
+	fflush (NULL);
+	prefetch_pid = fork ();
+	if (prefetch_pid < 0) {
+		debug ("can't fork to prefetch: %s\n", strerror (errno));
+		prefetch_pid = 0;
+		return;
+	} else if (prefetch_pid > 0) {
+		debug ("prefetching %s(%s) in process %ld\n",
+		       candp->source->name ? candp->source->name
+					   : candp->req_name,
+		       candp->source->ext, (long) prefetch_pid);
+		return;
+	}
+
+	/* Keep out of the way of the page being displayed. */
+	null_fd = open ("/dev/null", O_RDWR);
+	if (null_fd >= 0) {
+		dup2 (null_fd, STDIN_FILENO);
+		dup2 (null_fd, STDOUT_FILENO);
+		dup2 (null_fd, STDERR_FILENO);
+		if (null_fd > STDERR_FILENO)
+			close (null_fd);
+	}
+	prefetching = 1;
+
+	global_manpath = is_global_mandir (candp->path);
+	if (!global_manpath)
+		drop_effective_privs ();
+	if (candp->from_db == CANDIDATE_FILESYSTEM)
+		display_filesystem (candp);
+	else if (candp->from_db == CANDIDATE_DATABASE)
+		display_database (candp);
+	_exit (OK);
+}
+
+/* Wait for any page being prefetched to be ready. */
+static void wait_for_prefetch (void)
+{
+	int status;
+
+	if (!prefetch_pid)
+		return;
+	/* libpipeline may already have reaped it. */
+	while (waitpid (prefetch_pid, &status, 0) < 0 && errno == EINTR)
+		;
+	prefetch_pid = 0;
+}
+#endif /* MAN_CATS */
+
 static int display_pages (struct candidate *candidates)
 {
 	struct candidate *candp;
 	int found = 0;
 
 	for (candp = candidates; candp; candp = candp->next) {
+#ifdef MAN_CATS
+		wait_for_prefetch ();
+		if (findall && candp->next)
+			prefetch_page (candp->next);
+#endif /* MAN_CATS */
+
 		global_manpath = is_global_mandir (candp->path);
 		if (!global_manpath)
 			drop_effective_privs ();
@@ -3556,11 +4293,18 @@ static int display_pages (struct candidate *candidates)
  * do in apropos. If we ever add support to apropos/whatis for either
  * calling back to man or displaying pages directly, we should revisit this.
  */
-static int grep (const char *file, const char *string, const regex_t *search)
+struct grep_query {
+	regex_t regex;			/* if regex_opt */
+	struct strsearch *literal;	/* string that every match contains */
+};
+
+static int grep (const char *file, const struct grep_query *query)
 {
 	struct stat st;
-	pipeline *decomp;
-	const char *line;
+	char *text;
+	const char *start;
+	size_t len;
+	int stream = !regex_opt;
 	int ret = 0;
 
 	/* pipeline_start makes file open failures unconditionally fatal.
@@ -3569,29 +4313,241 @@ static int grep (const char *file, const char *string, const regex_t *search)
 	if (stat (file, &st) < 0)
 		return 0;
 
-	decomp = decompress_open (file);
-	if (!decomp)
+#ifdef HAVE_LIBZ
+	/* decompress_read_file reads these in-process, which is quicker
+	 * than a pipeline even though it has to read the whole page.
+	 */
+	if (stream) {
+		struct compression *comp = comp_info (file, 0);
+		if (!comp || STREQ (comp->ext, "gz"))
+			stream = 0;
+	}
+#endif /* HAVE_LIBZ */
+
+	/* Plain strings can be searched for as the page is decompressed,
+	 * stopping as soon as one is found.
+	 */
+	if (stream) {
+		pipeline *decomp = decompress_open (file);
+
+		if (!decomp)
+			return 0;
+		pipeline_start (decomp);
+		ret = strsearch_pipeline (query->literal, decomp);
+		pipeline_free (decomp);
+		return ret;
+	}
+
+	text = decompress_read_file (file, &len);
+	if (!text)
 		return 0;
-	pipeline_start (decomp);
-	while ((line = pipeline_readline (decomp)) != NULL) {
-		if (regex_opt) {
-			if (regexec (search, line,
-				     0, (regmatch_t *) 0, 0) == 0) {
-				ret = 1;
-				break;
-			}
-		} else {
-			if (match_case ?
-			    strstr (line, string) :
-			    strcasestr (line, string)) {
-				ret = 1;
-				break;
+
+	if (query->literal && !strsearch_find (query->literal, text, len))
+		ret = 0;
+	else if (!regex_opt)
+		ret = 1;
+	else {
+		/* Any NUL bytes would stop regexec early, so search each
+		 * stretch between them separately.
+		 */
+		start = text;
+		do {
+			ret = (regexec (&query->regex, start,
+					0, (regmatch_t *) 0, 0) == 0);
+			start += strlen (start) + 1;
+		} while (!ret && start < text + len);
+	}
+
+	free (text);
+	return ret;
+}
+
+/* Searching every page on the system is slow, so do_global_apropos_section
+ * shares the work among several processes.  Worker n of N searches pages
+ * n, n + N, n + 2N, and so on, and writes one byte for each page to its
+ * pipe saying whether it matched.  Reading the results from each worker in
+ * turn gives them in the original order, so that pages are offered for
+ * display in the same order as always, and as soon as they are found.
+ */
+#define GREP_WORKERS_MAX 8
+
+struct grep_pool {
+	int nworkers;
+	pid_t *pids;
+	int *fds;
+};
+
+static void grep_pool_free (struct grep_pool *pool)
+{
+	int i;
+
+	for (i = 0; i < pool->nworkers; ++i) {
+		if (pool->fds[i] >= 0)
+			close (pool->fds[i]);
+		if (pool->pids[i] > 0) {
+			int status;
+
+			kill (pool->pids[i], SIGTERM);
+			while (waitpid (pool->pids[i], &status, 0) < 0 &&
+			       errno == EINTR)
+				;
+		}
+	}
+	free (pool->fds);
+	free (pool->pids);
+	free (pool);
+}
+
+/* Start workers searching NAMES for QUERY.  Return NULL if there is no
+ * point, or if they could not be started, in which case the caller should
+ * search by itself.
+ */
+static struct grep_pool *grep_pool_start (char **names, size_t names_len,
+					  const struct grep_query *query)
+{
+	struct grep_pool *pool;
+	long ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+	int nworkers, i;
+
+	if (ncpus < 2 || names_len < 2)
+		return NULL;
+	nworkers = MIN (ncpus, GREP_WORKERS_MAX);
+	if ((size_t) nworkers > names_len)
+		nworkers = (int) names_len;
+
+	pool = XZALLOC (struct grep_pool);
+	pool->pids = XCALLOC (nworkers, pid_t);
+	pool->fds = XNMALLOC (nworkers, int);
+	for (i = 0; i < nworkers; ++i)
+		pool->fds[i] = -1;
+	pool->nworkers = nworkers;
+
+	fflush (NULL);
+	for (i = 0; i < nworkers; ++i) {
+		int fd[2];
+		size_t j;
+
+		if (pipe (fd) < 0) {
+			debug ("can't create pipe: %s\n", strerror (errno));
+			grep_pool_free (pool);
+			return NULL;
+		}
+		pool->pids[i] = fork ();
+		if (pool->pids[i] < 0) {
+			debug ("can't fork: %s\n", strerror (errno));
+			close (fd[0]);
+			close (fd[1]);
+			grep_pool_free (pool);
+			return NULL;
+		} else if (pool->pids[i] == 0) {
+			close (fd[0]);
+			for (j = 0; j < (size_t) i; ++j)
+				close (pool->fds[j]);
+			for (j = i; j < names_len; j += nworkers) {
+				char match = grep (names[j], query)
+					? '1' : '0';
+				if (write (fd[1], &match, 1) != 1)
+					break;
 			}
+			_exit (OK);
 		}
+		close (fd[1]);
+		pool->fds[i] = fd[0];
 	}
 
-	pipeline_free (decomp);
-	return ret;
+	debug ("searching with %d worker processes\n", nworkers);
+	return pool;
+}
+
+/* Return non-zero if NAMES[I] matched. */
+static int grep_pool_result (struct grep_pool *pool, char **names, size_t i,
+			     const struct grep_query *query)
+{
+	int fd = pool->fds[i % pool->nworkers];
+	char match;
+	ssize_t r;
+
+	do
+		r = read (fd, &match, 1);
+	while (r < 0 && errno == EINTR);
+	if (r == 1)
+		return match == '1';
+
+	/* The worker went away; do its job ourselves. */
+	return grep (names[i], query);
+}
+
+/* Full-text indexes written by mandb, indexed by manpath.  A hierarchy
+ * without one is recorded with a NULL index so that we only look once.
+ */
+static struct hashtable *fulltext_hash = NULL;
+
+struct fulltext_hash_entry {
+	struct fulltext_index *index;
+};
+
+static void fulltext_hashtable_free (void *defn)
+{
+	struct fulltext_hash_entry *entry = defn;
+
+	fulltext_free (entry->index);
+	free (entry);
+}
+
+static struct fulltext_index *get_fulltext_index (const char *path)
+{
+	struct fulltext_hash_entry *entry;
+	char *catpath, *file;
+
+	if (!fulltext_hash)
+		fulltext_hash = hashtable_create (&fulltext_hashtable_free);
+	entry = hashtable_lookup (fulltext_hash, path, strlen (path));
+	if (entry)
+		return entry->index;
+
+	catpath = get_catpath (path, global_manpath ? SYSTEM_CAT : USER_CAT);
+	file = xasprintf ("%s%s", catpath ? catpath : path, MAN_FULLTEXT);
+	entry = XMALLOC (struct fulltext_hash_entry);
+	entry->index = fulltext_load (file);
+	hashtable_install (fulltext_hash, path, strlen (path), entry);
+	free (file);
+	free (catpath);
+	return entry->index;
+}
+
+/* Remove from NAMES, which are within PATH, those pages that the full-text
+ * index shows cannot match NAME.  Return the new number of names.
+ */
+static size_t fulltext_filter (const char *path, char **names,
+			       size_t names_len, const char *name)
+{
+	struct fulltext_index *index = get_fulltext_index (path);
+	struct fulltext_query *query;
+	size_t path_len = strlen (path), i, kept = 0;
+
+	if (!index)
+		return names_len;
+	query = fulltext_query_new (name, regex_opt);
+	if (!query)
+		return names_len;
+
+	for (i = 0; i < names_len; ++i) {
+		struct stat st;
+
+		if (STRNEQ (names[i], path, path_len) &&
+		    names[i][path_len] == '/' &&
+		    stat (names[i], &st) == 0 &&
+		    !fulltext_may_match (index, query,
+					 names[i] + path_len + 1, &st))
+			continue;
+		names[kept++] = names[i];
+	}
+	names[kept] = NULL;
+
+	debug ("full-text index leaves %zu of %zu pages to search\n",
+	       kept, names_len);
+	fulltext_query_free (query);
+	return kept;
 }
 
 static int do_global_apropos_section (const char *path, const char *sec,
@@ -3600,7 +4556,8 @@ static int do_global_apropos_section (const char *path, const char *sec,
 	int found = 0;
 	char **names, **np;
 	size_t names_len = 0;
-	regex_t search;
+	struct grep_query query;
+	struct grep_pool *pool;
 
 	global_manpath = is_global_mandir (path);
 	if (!global_manpath)
@@ -3609,17 +4566,45 @@ static int do_global_apropos_section (const char *path, const char *sec,
 	debug ("searching in %s, section %s\n", path, sec);
 
 	names = look_for_file (path, sec, "*", 0, LFF_WILDCARD);
-	if (regex_opt)
-		xregcomp (&search, name,
-			  REG_EXTENDED | REG_NOSUB |
+	memset (&query, 0, sizeof query);
+	if (regex_opt) {
+		char *literal = strsearch_regex_literal (name);
+		const char *p;
+
+		xregcomp (&query.regex, name,
+			  REG_EXTENDED | REG_NOSUB | REG_NEWLINE |
 			  (match_case ? 0 : REG_ICASE));
-	else
-		memset (&search, 0, sizeof search);
+
+		/* Pages without the literal cannot match, and finding that
+		 * out is much quicker than running the regex.  Byte-wise
+		 * case folding is only safe for ASCII, though.
+		 */
+		for (p = literal; p && *p && !match_case; ++p) {
+			if ((unsigned char) *p >= 0x80) {
+				free (literal);
+				literal = NULL;
+				break;
+			}
+		}
+		if (literal) {
+			debug ("prefiltering on \"%s\"\n", literal);
+			query.literal = strsearch_new (literal, !match_case);
+			free (literal);
+		}
+	} else
+		query.literal = strsearch_new (name, !match_case);
 
 	for (np = names; np && *np; ++np)
 		++names_len;
+	/* look_for_file owns its result, so work on a copy. */
+	if (names) {
+		names = xmemdup (names, (names_len + 1) * sizeof *names);
+		names_len = fulltext_filter (path, names, names_len, name);
+	}
 	order_files (path, names, names_len);
 
+	pool = grep_pool_start (names, names_len, &query);
+
 	for (np = names; np && *np; ++np) {
 		struct mandata *info;
 		char *info_buffer;
@@ -3627,7 +4612,8 @@ static int do_global_apropos_section (const char *path, const char *sec,
 		const char *man_file;
 		char *cat_file = NULL;
 
-		if (!grep (*np, name, &search))
+		if (pool ? !grep_pool_result (pool, names, np - names, &query)
+			 : !grep (*np, &query))
 			continue;
 
 		info = infoalloc ();
@@ -3654,8 +4640,12 @@ next:
 		free_mandata_struct (info);
 	}
 
+	if (pool)
+		grep_pool_free (pool);
+	free (names);
+	strsearch_free (query.literal);
 	if (regex_opt)
-		regfree (&search);
+		regfree (&query.regex);
 
 	if (!global_manpath)
 		regain_effective_privs ();
@@ -3761,6 +4751,7 @@ static int local_man_loop (const char *argv)
 				memcpy (old_manpathlist, manpathlist,
 					MAXDIRS * sizeof (*manpathlist));
 				create_pathlist (new_manp, manpathlist);
+				register_manifests (manpathlist);
 
 				man (argv_base, &found);
 
@@ -3964,6 +4955,12 @@ int main (int argc, char *argv[])
 	if (argp_parse (&argp, argc, argv, ARGP_NO_ARGS, &first_arg, 0))
 		exit (FAIL);
 
+	/* Updating the database is only worth doing if it is quick, so
+	 * don't wait for another process (mandb, perhaps) to finish with
+	 * it.
+	 */
+	dblog_lock_wait = 0;
+
 #ifdef SECURE_MAN_UID
 	/* record who we are and drop effective privs for later use */
 	init_security ();
@@ -4070,6 +5067,7 @@ int main (int argc, char *argv[])
 	debug ("manpath search path (with duplicates) = %s\n", manp);
 
 	create_pathlist (manp, manpathlist);
+	register_manifests (manpathlist);
 
 	/* man issued with `-l' option */
 	if (local_man_file) {
@@ -4158,10 +5156,6 @@ int main (int argc, char *argv[])
 				status = man (nextarg, &found);
 		}
 
-		/* clean out the cache of database lookups for each man page */
-		hashtable_free (db_hash);
-		db_hash = NULL;
-
 		if (section && maybe_section) {
 			if (status != OK && !catman) {
 				/* Maybe the section wasn't a section after
@@ -4184,8 +5178,6 @@ int main (int argc, char *argv[])
 				}
 				if (!found_subpage)
 					status = man (tmp, &found);
-				hashtable_free (db_hash);
-				db_hash = NULL;
 				/* ... but don't gripe about it if it doesn't
 				 * work!
 				 */
@@ -4232,6 +5224,8 @@ int main (int argc, char *argv[])
 	}
 	hashtable_free (db_hash);
 	db_hash = NULL;
+	hashtable_free (dbf_hash);
+	dbf_hash = NULL;
 
 	drop_effective_privs ();
 
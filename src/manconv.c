@@ -60,6 +60,52 @@
 
 #ifdef HAVE_ICONV
 
+/* iconv_open can be expensive, since it may have to load gconv modules,
+ * and mandb converts thousands of pages between the same few pairs of
+ * encodings.  Descriptors are therefore kept open for the life of the
+ * process, and reset before each use.  Since manconv normally runs in a
+ * child of the process that built the pipeline, that process opens them in
+ * advance (see manconv_preload()) so that each child inherits them.
+ */
+struct iconv_cache_entry {
+	char *to, *from;
+	iconv_t cd;
+};
+
+static struct iconv_cache_entry *iconv_cache = NULL;
+static size_t iconv_cache_len = 0;
+
+static iconv_t cached_iconv_open (const char *to, const char *from)
+{
+	iconv_t cd;
+	size_t i;
+
+	for (i = 0; i < iconv_cache_len; ++i) {
+		if (STREQ (iconv_cache[i].to, to) &&
+		    STREQ (iconv_cache[i].from, from)) {
+			cd = iconv_cache[i].cd;
+			iconv (cd, NULL, NULL, NULL, NULL);
+			return cd;
+		}
+	}
+
+	cd = iconv_open (to, from);
+	if (cd == (iconv_t) -1)
+		return cd;
+	iconv_cache = xnrealloc (iconv_cache, iconv_cache_len + 1,
+				 sizeof *iconv_cache);
+	iconv_cache[iconv_cache_len].to = xstrdup (to);
+	iconv_cache[iconv_cache_len].from = xstrdup (from);
+	iconv_cache[iconv_cache_len].cd = cd;
+	++iconv_cache_len;
+	return cd;
+}
+
+static int is_utf8_target (const char *to)
+{
+	return STREQ (to, "UTF-8") || STRNEQ (to, "UTF-8//", 7);
+}
+
 /* When converting text containing an invalid multibyte sequence to
  * UTF-8//IGNORE, GNU libc's iconv returns EILSEQ but sets *inbuf to the end
  * of the input buffer.  I'm not sure whether this is a bug or not (it seems
@@ -76,7 +122,7 @@ static off_t locate_error (const char *try_from_code,
 	size_t n;
 	off_t ret;
 
-	cd_utf8_strict = iconv_open ("UTF-8", try_from_code);
+	cd_utf8_strict = cached_iconv_open ("UTF-8", try_from_code);
 	if (cd_utf8_strict == (iconv_t) -1) {
 		error (0, errno, "iconv_open (\"UTF-8\", \"%s\")",
 		       try_from_code);
@@ -90,11 +136,103 @@ static off_t locate_error (const char *try_from_code,
 	else
 		ret = 0;
 
-	iconv_close (cd_utf8_strict);
-
 	return ret;
 }
 
+/* Peek at up to BUF_SIZE bytes of input.  End of file, error, or just a
+ * short read?  Repeat until we have either a full buffer or EOF/error.
+ */
+static const char *peek_buffer (pipeline *p, size_t buf_size,
+				size_t *input_size)
+{
+	const char *input;
+
+	*input_size = buf_size;
+	input = pipeline_peek (p, input_size);
+	while (*input_size < buf_size) {
+		size_t old_input_size = *input_size;
+		*input_size = buf_size;
+		input = pipeline_peek (p, input_size);
+		if (*input_size == old_input_size)
+			break;
+	}
+	return input;
+}
+
+static void write_output (const char *buf, size_t len)
+{
+	if (fwrite (buf, 1, len, stdout) < len || ferror (stdout))
+		error (FATAL, 0, _("can't write to standard output"));
+}
+
+/* Return the length of the longest prefix of the SIZE bytes at BUF made
+ * up of complete, valid UTF-8 characters, rejecting overlong forms,
+ * surrogates, and code points above U+10FFFF just as iconv does.  Set
+ * *TRUNCATED if the rest of the buffer is a valid start of a character
+ * that was cut off by the end of the buffer.
+ */
+static size_t utf8_valid_prefix (const char *buf, size_t size,
+				 int *truncated)
+{
+	const unsigned char *s = (const unsigned char *) buf;
+	const unsigned char *end = s + size;
+
+	*truncated = 0;
+	while (s < end) {
+		unsigned char lo = 0x80, hi = 0xBF;
+		size_t need, i;
+
+		if (*s < 0x80) {
+			/* Manual pages are mostly ASCII, so skip that a
+			 * word at a time.
+			 */
+			while ((size_t) (end - s) >= sizeof (uint64_t)) {
+				uint64_t word;
+
+				memcpy (&word, s, sizeof word);
+				if (word & UINT64_C (0x8080808080808080))
+					break;
+				s += sizeof word;
+			}
+			while (s < end && *s < 0x80)
+				++s;
+			continue;
+		}
+
+		if (*s >= 0xC2 && *s <= 0xDF)
+			need = 1;
+		else if (*s >= 0xE0 && *s <= 0xEF) {
+			need = 2;
+			if (*s == 0xE0)
+				lo = 0xA0;
+			else if (*s == 0xED)
+				hi = 0x9F;
+		} else if (*s >= 0xF0 && *s <= 0xF4) {
+			need = 3;
+			if (*s == 0xF0)
+				lo = 0x90;
+			else if (*s == 0xF4)
+				hi = 0x8F;
+		} else
+			break;
+
+		for (i = 1; i <= need; ++i) {
+			if (s + i == end) {
+				*truncated = 1;
+				goto out;
+			}
+			if (s[i] < lo || s[i] > hi)
+				goto out;
+			lo = 0x80;
+			hi = 0xBF;
+		}
+		s += need + 1;
+	}
+
+out:
+	return s - (const unsigned char *) buf;
+}
+
 static int try_iconv (pipeline *p, const char *try_from_code, const char *to,
 		      int last)
 {
@@ -106,15 +244,14 @@ static int try_iconv (pipeline *p, const char *try_from_code, const char *to,
 	static char *utf8 = NULL, *output = NULL;
 	size_t utf8left = 0;
 	iconv_t cd_utf8, cd = NULL;
-	int to_utf8 = STREQ (try_to_code, "UTF-8") ||
-		      STRNEQ (try_to_code, "UTF-8//", 7);
+	int to_utf8 = is_utf8_target (try_to_code);
 	const char *utf8_target = last ? "UTF-8//IGNORE" : "UTF-8";
 	int ignore_errors = (strstr (try_to_code, "//IGNORE") != NULL);;
 	int ret = 0;
 
 	debug ("trying encoding %s -> %s\n", try_from_code, try_to_code);
 
-	cd_utf8 = iconv_open (utf8_target, try_from_code);
+	cd_utf8 = cached_iconv_open (utf8_target, try_from_code);
 	if (cd_utf8 == (iconv_t) -1) {
 		error (0, errno, "iconv_open (\"%s\", \"%s\")",
 		       utf8_target, try_from_code);
@@ -123,7 +260,7 @@ static int try_iconv (pipeline *p, const char *try_from_code, const char *to,
 	}
 
 	if (!to_utf8) {
-		cd = iconv_open (try_to_code, "UTF-8");
+		cd = cached_iconv_open (try_to_code, "UTF-8");
 		if (cd == (iconv_t) -1) {
 			error (0, errno, "iconv_open (\"%s\", \"UTF-8\")",
 			       try_to_code);
@@ -132,17 +269,35 @@ static int try_iconv (pipeline *p, const char *try_from_code, const char *to,
 		}
 	}
 
-	input = pipeline_peek (p, &input_size);
-	if (input_size < buf_size) {
-		/* End of file, error, or just a short read? Repeat until we
-		 * have either a full buffer or EOF/error.
+	input = peek_buffer (p, buf_size, &input_size);
+
+	if (to_utf8 && STREQ (try_from_code, "UTF-8")) {
+		/* Text that is already valid UTF-8 needs no conversion, so
+		 * write it straight from the input buffer.  Only hand over
+		 * to iconv once we reach something that is not valid.
 		 */
-		while (input_size < buf_size) {
-			size_t old_input_size = input_size;
-			input_size = buf_size;
-			input = pipeline_peek (p, &input_size);
-			if (input_size == old_input_size)
-				break;
+		while (input_size) {
+			int truncated;
+			size_t valid = utf8_valid_prefix (input, input_size,
+							  &truncated);
+
+			if (valid < input_size &&
+			    !(truncated && input_size == buf_size)) {
+				/* Unless we are going to skip invalid
+				 * input and this is not the end of the file
+				 * (where an incomplete character is fatal),
+				 * leave this whole buffer to iconv so that it
+				 * fails just as it would have done otherwise.
+				 */
+				if (!last || !ignore_errors || !valid ||
+				    input_size < buf_size)
+					break;
+			}
+
+			write_output (input, valid);
+			pipeline_peek_skip (p, valid);
+			input_pos += valid;
+			input = peek_buffer (p, buf_size, &input_size);
 		}
 	}
 
@@ -293,27 +448,71 @@ static int try_iconv (pipeline *p, const char *try_from_code, const char *to,
 		 * so is unlikely for legacy encodings), we need to fetch
 		 * more input text now.
 		 */
-		if (!utf8left) {
-			input_size = buf_size;
-			input = pipeline_peek (p, &input_size);
-			while (input_size < buf_size) {
-				size_t old_input_size = input_size;
-				input_size = buf_size;
-				input = pipeline_peek (p, &input_size);
-				if (input_size == old_input_size)
-					break;
-			}
-		}
+		if (!utf8left)
+			input = peek_buffer (p, buf_size, &input_size);
 	}
 
-	if (!to_utf8)
-		iconv_close (cd);
-	iconv_close (cd_utf8);
 	free (try_to_code);
 
 	return ret;
 }
 
+/* Check whether all the input from P is valid UTF-8, peeking at it a
+ * buffer at a time so that it is still there to be converted afterwards.
+ */
+static int input_is_utf8 (pipeline *p)
+{
+	static const size_t buf_size = 65536;
+	size_t checked = 0;
+
+	for (;;) {
+		size_t want = checked + buf_size, input_size, valid;
+		const char *input = peek_buffer (p, want, &input_size);
+		int truncated;
+
+		valid = utf8_valid_prefix (input + checked,
+					   input_size - checked, &truncated);
+		if (checked + valid == input_size) {
+			if (input_size < want)
+				return 1;
+		} else if (!truncated || input_size < want) {
+			debug ("byte %ju is not valid UTF-8\n",
+			       (uintmax_t) (checked + valid));
+			return 0;
+		}
+		checked += valid;
+	}
+}
+
+/* Copy all the input from P to standard output unchanged. */
+static void copy_input (pipeline *p)
+{
+	for (;;) {
+		size_t len = 65536;
+		const char *buffer = pipeline_read (p, &len);
+		if (len == 0)
+			break;
+		write_output (buffer, len);
+	}
+}
+
+/* Open the conversion descriptors that manconv (P, FROM, TO) will need,
+ * so that processes forked afterwards can use them straight away.
+ */
+void manconv_preload (char * const *from, const char *to)
+{
+	char * const *try_from_code;
+
+	for (try_from_code = from; *try_from_code; ++try_from_code) {
+		const char *utf8_target =
+			*(try_from_code + 1) ? "UTF-8" : "UTF-8//IGNORE";
+
+		cached_iconv_open (utf8_target, *try_from_code);
+	}
+	if (!is_utf8_target (to))
+		cached_iconv_open (to, "UTF-8");
+}
+
 void manconv (pipeline *p, char * const *from, const char *to)
 {
 	char *pp_encoding;
@@ -324,7 +523,28 @@ void manconv (pipeline *p, char * const *from, const char *to)
 		try_iconv (p, pp_encoding, to, 1);
 		free (pp_encoding);
 	} else {
-		for (try_from_code = from; *try_from_code; ++try_from_code)
+		try_from_code = from;
+
+		/* Decide whether the page is in UTF-8 by looking at all of
+		 * it before writing anything, rather than converting it a
+		 * buffer at a time and starting again with the next
+		 * encoding from the first buffer that is not valid UTF-8.
+		 * This also means that a page is never converted partly
+		 * from one encoding and partly from another.
+		 */
+		if (STREQ (*try_from_code, "UTF-8") && *(try_from_code + 1)) {
+			if (input_is_utf8 (p)) {
+				debug ("input is valid UTF-8\n");
+				if (is_utf8_target (to))
+					copy_input (p);
+				else
+					try_iconv (p, "UTF-8", to, 1);
+				return;
+			}
+			++try_from_code;
+		}
+
+		for (; *try_from_code; ++try_from_code)
 			if (try_iconv (p, *try_from_code, to,
 				       !*(try_from_code + 1)) == 0)
 				break;
@@ -333,6 +553,11 @@ void manconv (pipeline *p, char * const *from, const char *to)
 
 #else /* !HAVE_ICONV */
 
+void manconv_preload (char * const *from ATTRIBUTE_UNUSED,
+		      const char *to ATTRIBUTE_UNUSED)
+{
+}
+
 /* If we don't have iconv, there isn't much we can do; just pass everything
  * through unchanged.
  */
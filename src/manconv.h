@@ -20,4 +20,5 @@
  * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+void manconv_preload (char * const *from, const char *to);
 void manconv (struct pipeline *p, char * const *from, const char *to);
@@ -136,6 +136,11 @@ void add_manconv (pipeline *p, const char *source, const char *target)
 	name = appendstr (name, " -t ", codes->to, NULL);
 	if (quiet >= 2)
 		name = appendstr (name, " -q", NULL);
+	/* Setuid processes execute manconv instead; see manconv_stdin. */
+#ifdef SECURE_MAN_UID
+	if (!running_setuid ())
+#endif /* SECURE_MAN_UID */
+		manconv_preload (codes->from, codes->to);
 	cmd = pipecmd_new_function (name, &manconv_stdin, &free_manconv_codes,
 				    codes);
 	free (name);
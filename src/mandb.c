@@ -63,6 +63,7 @@
 #include "error.h"
 #include "cleanup.h"
 #include "hashtable.h"
+#include "manifest.h"
 #include "pipeline.h"
 #include "security.h"
 
@@ -70,6 +71,8 @@
 
 #include "check_mandirs.h"
 #include "filenames.h"
+#include "fragments.h"
+#include "fulltext.h"
 #include "manp.h"
 
 char *program_name;
@@ -79,8 +82,10 @@ char *manp;
 char *database = NULL;
 extern char *extension;		/* for globbing.c */
 extern int force_rescan;	/* for check_mandirs.c */
+extern int from_fragments;	/* for check_mandirs.c */
 static char *single_filename = NULL;
 extern char *user_config_file;	/* for manp.c */
+extern int fulltext_index;	/* for manp.c */
 #ifdef SECURE_MAN_UID
 struct passwd *man_owner;
 #endif
@@ -91,6 +96,7 @@ static int check_for_strays = 1;
 static int purge = 1;
 static int user;
 static int create;
+static int portable;
 static const char *arg_manp;
 
 struct tried_catdirs_entry {
@@ -104,6 +110,12 @@ error_t argp_err_exit_status = FAIL;
 
 static const char args_doc[] = N_("[MANPATH]");
 
+enum opts {
+	OPT_PORTABLE = 256,
+	OPT_FROM_FRAGMENTS,
+	OPT_MAX
+};
+
 static struct argp_option options[] = {
 	{ "debug",		'd',	0,		0,	N_("emit debugging messages") },
 	{ "quiet",		'q',	0,		0,	N_("work quietly, except for 'bogus' warning") },
@@ -114,6 +126,10 @@ static struct argp_option options[] = {
 	{ "test",		't',	0,		0,	N_("check manual pages for correctness") },
 	{ "filename",		'f',	N_("FILENAME"),	0,	N_("update just the entry for this filename") },
 	{ "config-file",	'C',	N_("FILE"),	0,	N_("use this user configuration file") },
+	{ "portable",		OPT_PORTABLE,
+					0,		0,	N_("also write a reproducible, portable copy of each database") },
+	{ "from-fragments",	OPT_FROM_FRAGMENTS,
+					0,		0,	N_("use precomputed whatis fragments where available") },
 	{ 0, 'h', 0, OPTION_HIDDEN, 0 }, /* compatibility for --help */
 	{ 0 }
 };
@@ -154,6 +170,12 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 		case 'C':
 			user_config_file = arg;
 			return 0;
+		case OPT_PORTABLE:
+			portable = 1;
+			return 0;
+		case OPT_FROM_FRAGMENTS:
+			from_fragments = 1;
+			return 0;
 		case 'h':
 			argp_state_help (state, state->out_stream,
 					 ARGP_HELP_STD_HELP);
@@ -192,6 +214,7 @@ struct dbpaths {
 	char *xfile;
 	char *xtmpfile;
 #endif /* NDBM */
+	int replace;	/* put the temporary database in place */
 };
 
 #ifdef SECURE_MAN_UID
@@ -228,73 +251,6 @@ static void xchmod (const char *path, mode_t mode)
 	}
 }
 
-/* CPhipps 2000/02/24 - Copy a file. */
-static int xcopy (const char *from, const char *to)
-{
-	FILE *ifp, *ofp;
-	struct stat st;
-	struct timespec times[2];
-	static const size_t buf_size = 32 * 1024;
-	char *buf;
-	int ret = 0;
-
-	ifp = fopen (from, "r");
-	if (!ifp) {
-		ret = -errno;
-		if (errno == ENOENT)
-			return 0;
-		error (0, errno, "fopen %s", from);
-		return ret;
-	}
-
-	if (fstat (fileno (ifp), &st) >= 0) {
-		times[0] = get_stat_atime (&st);
-		times[1] = get_stat_mtime (&st);
-	} else {
-		times[0].tv_sec = 0;
-		times[0].tv_nsec = UTIME_OMIT;
-		times[1].tv_sec = 0;
-		times[1].tv_nsec = UTIME_OMIT;
-	}
-
-	ofp = fopen (to, "w");
-	if (!ofp) {
-		ret = -errno;
-		error (0, errno, "fopen %s", to);
-		fclose (ifp);
-		return ret;
-	}
-
-	buf = xmalloc (buf_size);
-	while (!feof (ifp) && !ferror (ifp)) {
-		size_t in = fread (buf, 1, buf_size, ifp);
-		if (in > 0) {
-			if (fwrite (buf, 1, in, ofp) == 0 && ferror (ofp)) {
-				ret = -errno;
-				error (0, errno, _("can't write to %s"), to);
-				break;
-			}
-		} else if (ferror (ifp)) {
-			ret = -errno;
-			error (0, errno, _("can't read from %s"), from);
-			break;
-		}
-	}
-	free (buf);
-
-	fclose (ifp);
-	fclose (ofp);
-
-	if (ret < 0)
-		xremove (to);
-	else {
-		xchmod (to, DBMODE);
-		utimens (to, times);
-	}
-
-	return ret;
-}
-
 /* rename and chmod the database */
 static void finish_up (struct dbpaths *dbpaths)
 {
@@ -348,44 +304,66 @@ static void do_chown (struct dbpaths *dbpaths, uid_t uid)
 #endif /* SECURE_MAN_UID */
 
 /* Update a single file in an existing database. */
-static int update_one_file (const char *manpath, const char *filename)
+static int update_one_file_wrapper (const char *manpath, const char *filename)
 {
 	MYDBM_FILE dbf;
 
 	dbf = MYDBM_RWOPEN (database);
 	if (dbf) {
-		struct mandata info;
-		char *manpage;
-
-		memset (&info, 0, sizeof (struct mandata));
-		manpage = filename_info (filename, &info, "");
-		if (info.name) {
-			dbdelete (dbf, info.name, &info);
-			purge_pointers (dbf, info.name);
-			free (info.name);
-		}
-		free (manpage);
-
-		test_manfile (dbf, filename, manpath);
+		update_one_file (dbf, manpath, filename);
+		MYDBM_CLOSE (dbf);
 	}
-	MYDBM_CLOSE (dbf);
 
 	return 1;
 }
 
-/* dont actually create any dbs, just do an update */
-static int update_db_wrapper (const char *manpath, const char *catpath)
+/* Create a database from scratch, loading a portable database built from
+ * an identical hierarchy instead if there is one.
+ */
+static int create_db_wrapper (const char *manpath, const char *catpath)
+{
+	int amount = import_portable_db (manpath, catpath);
+	if (amount >= 0)
+		return amount;
+
+	return create_db (manpath, catpath);
+}
+
+/* Is there a portable database newer than the existing database dbname,
+ * for instance from a system image update?  If so, it supersedes it.
+ * Changes in the database's log count towards its age.
+ */
+static int newer_portable_db (const char *catpath, const char *dbname)
 {
-	int amount;
+	char *portable_db;
+	struct stat portable_st;
+	MYDBM_FILE dbf;
+	int newer = 0;
 
 	if (single_filename)
-		return update_one_file (manpath, single_filename);
+		return 0;
 
-	amount = update_db (manpath, catpath);
-	if (amount != EOF)
-		return amount;
+	portable_db = xasprintf ("%s%s", catpath, MAN_DB_PORTABLE);
+	if (stat (portable_db, &portable_st) == 0 &&
+	    (dbf = MYDBM_RDOPEN (dbname)) != NULL) {
+		if (timespec_cmp (get_stat_mtime (&portable_st),
+				  MYDBM_GET_TIME (dbf)) > 0) {
+			debug ("%s is newer than %s\n", portable_db, dbname);
+			newer = 1;
+		}
+		MYDBM_CLOSE (dbf);
+	}
+	free (portable_db);
+	return newer;
+}
 
-	return create_db (manpath, catpath);
+/* dont actually create any dbs, just do an update */
+static int update_db_wrapper (const char *manpath, const char *catpath)
+{
+	if (single_filename)
+		return update_one_file_wrapper (manpath, single_filename);
+
+	return update_db (manpath, catpath);
 }
 
 /* remove incomplete databases */
@@ -440,16 +418,41 @@ static void cleanup (void *arg)
 	"# For information about cache directory tags, see:\n" \
 	"#\thttp://www.brynosaurus.com/cachedir/\n"
 
+/* Fill in DBPATHS with the names of the files making up the database
+ * DBNAME and of the temporary copy DATABASE that will replace it.
+ */
+static void set_dbpaths (struct dbpaths *dbpaths, const char *dbname)
+{
+#ifdef NDBM
+#  ifdef BERKELEY_DB
+	dbpaths->dbfile = xasprintf ("%s.db", dbname);
+	dbpaths->tmpdbfile = xasprintf ("%s.db", database);
+	xremove (dbpaths->tmpdbfile);
+#  else /* !BERKELEY_DB NDBM */
+	dbpaths->dirfile = xasprintf ("%s.dir", dbname);
+	dbpaths->pagfile = xasprintf ("%s.pag", dbname);
+	dbpaths->tmpdirfile = xasprintf ("%s.dir", database);
+	dbpaths->tmppagfile = xasprintf ("%s.pag", database);
+	xremove (dbpaths->tmpdirfile);
+	xremove (dbpaths->tmppagfile);
+#  endif /* BERKELEY_DB NDBM */
+#else /* !NDBM */
+	dbpaths->xfile = xstrdup (dbname);
+	dbpaths->xtmpfile = xstrdup (database);
+	xremove (dbpaths->xtmpfile);
+#endif /* NDBM */
+	dbpaths->replace = 1;
+}
+
 /* sort out the database names */
 static int mandb (struct dbpaths *dbpaths,
 		  const char *catpath, const char *manpath, int global_manpath)
 {
-	int ret, amount;
+	int ret;
 	char *dbname;
 	int should_create;
 
 	dbname = mkdbname (catpath);
-	database = xasprintf ("%s/%d", catpath, getpid ());
 
 	if (!quiet) 
 		printf (_("Processing manual pages under %s...\n"), manpath);
@@ -482,75 +485,220 @@ static int mandb (struct dbpaths *dbpaths,
 	}
 
 	should_create = (create || force_rescan || opt_test);
+	if (!should_create && newer_portable_db (catpath, dbname))
+		should_create = 1;
 
-#ifdef NDBM
-#  ifdef BERKELEY_DB
-	dbpaths->dbfile = xasprintf ("%s.db", dbname);
-	free (dbname);
-	dbpaths->tmpdbfile = xasprintf ("%s.db", database);
 	if (!should_create) {
-		if (xcopy (dbpaths->dbfile, dbpaths->tmpdbfile) < 0)
-			should_create = 1;
-	}
-	if (should_create) {
-		xremove (dbpaths->tmpdbfile);
-		ret = create_db (manpath, catpath);
-		if (ret < 0)
-			return ret;
-		amount = ret;
-	} else {
+		/* Changes go to the log alongside the database, so there
+		 * is no need to copy it first.
+		 */
+		database = dbname;
 		ret = update_db_wrapper (manpath, catpath);
-		if (ret < 0)
+		if (ret != EOF)
 			return ret;
-		amount = ret;
 	}
-#  else /* !BERKELEY_DB NDBM */
-	dbpaths->dirfile = xasprintf ("%s.dir", dbname);
-	dbpaths->pagfile = xasprintf ("%s.pag", dbname);
+
+	/* Build a new database privately, and put it in place once it is
+	 * complete.
+	 */
+	database = xasprintf ("%s/%d", catpath, getpid ());
+	set_dbpaths (dbpaths, dbname);
 	free (dbname);
-	dbpaths->tmpdirfile = xasprintf ("%s.dir", database);
-	dbpaths->tmppagfile = xasprintf ("%s.pag", database);
-	if (!should_create) {
-		if (xcopy (dbpaths->dirfile, dbpaths->tmpdirfile) < 0 ||
-		    xcopy (dbpaths->pagfile, dbpaths->tmppagfile) < 0)
-			should_create = 1;
-	}
-	if (should_create) {
-		xremove (dbpaths->tmpdirfile);
-		xremove (dbpaths->tmppagfile);
-		ret = create_db (manpath, catpath);
-		if (ret < 0)
-			return ret;
-		amount = ret;
-	} else {
-		ret = update_db_wrapper (manpath, catpath);
-		if (ret < 0)
-			return ret;
-		amount = ret;
+	dblog_bypass = 1;
+	ret = create_db_wrapper (manpath, catpath);
+	dblog_bypass = 0;
+
+	return ret;
+}
+
+/* Does CATPATH hold a database?  Hierarchies with no pages, such as cat
+ * directories examined for per-locale pages, have none, and so need no
+ * manifest or portable database either.
+ */
+static int database_exists (const char *catpath)
+{
+	char *dbname = mkdbname (catpath);
+	MYDBM_FILE dbf = MYDBM_RDOPEN (dbname);
+
+	free (dbname);
+	if (!dbf)
+		return 0;
+	MYDBM_CLOSE (dbf);
+	return 1;
+}
+
+/* Keep the file metadata manifest for this hierarchy up to date.  If
+ * nothing was added to the database, only rewrite it if any of the
+ * directories it describes have changed.
+ */
+static void update_manifest (const char *manpath, const char *catpath,
+			     int global_manpath ATTRIBUTE_UNUSED, int changed)
+{
+	char *manifest = xasprintf ("%s%s", catpath, MAN_MANIFEST);
+
+	if (changed || !manifest_is_current (manpath, manifest)) {
+		if (manifest_write (manpath, manifest) < 0)
+			error (0, errno, _("can't write manifest %s"),
+			       manifest);
+#ifdef SECURE_MAN_UID
+		else if (global_manpath && euid == 0)
+			xchown (manifest, man_owner->pw_uid, -1);
+#endif /* SECURE_MAN_UID */
 	}
-#  endif /* BERKELEY_DB NDBM */
-#else /* !NDBM */
-	dbpaths->xfile = dbname; /* steal memory */
-	dbpaths->xtmpfile = xstrdup (database);
-	if (!should_create) {
-		if (xcopy (dbpaths->xfile, dbpaths->xtmpfile) < 0)
-			should_create = 1;
+
+	free (manifest);
+}
+
+/* Update the section index of the database if it has changed, or if it
+ * does not have one yet.
+ */
+static void update_sections_index (int changed)
+{
+	MYDBM_FILE dbf;
+
+	if (!changed) {
+		dbf = MYDBM_RDOPEN (database);
+		if (!dbf)
+			return;
+		changed = !dbsections_exist (dbf);
+		MYDBM_CLOSE (dbf);
+		if (!changed)
+			return;
 	}
-	if (should_create) {
-		xremove (dbpaths->xtmpfile);
-		ret = create_db (manpath, catpath);
-		if (ret < 0)
-			return ret;
-		amount = ret;
-	} else {
-		ret = update_db_wrapper (manpath, catpath);
-		if (ret < 0)
-			return ret;
-		amount = ret;
+
+	dbf = MYDBM_RWOPEN (database);
+	if (!dbf) {
+		if (errno != EACCES && errno != EROFS &&
+		    errno != EAGAIN && errno != EWOULDBLOCK)
+			error (0, errno, _("can't update index cache %s"),
+			       database);
+		return;
 	}
-#endif /* NDBM */
+	dbsections_build (dbf);
+	MYDBM_CLOSE (dbf);
+}
 
-	return amount;
+/* Once the log of changes alongside the database has grown large enough,
+ * fold it into a new database.
+ */
+static void compact_db (const char *catpath,
+			int global_manpath ATTRIBUTE_UNUSED)
+{
+	char *dbname = mkdbname (catpath);
+	char *log = dblog_name (dbname);
+	struct dbpaths dbpaths;
+	struct stat st;
+	MYDBM_FILE dbf;
+
+	if (stat (log, &st) < 0)
+		goto out;
+	dbf = MYDBM_RWOPEN (dbname);
+	if (!dbf)
+		goto out;
+
+	if (!dblog_wants_compaction (dbf)) {
+#ifdef SECURE_MAN_UID
+		if (global_manpath && euid == 0 &&
+		    chown (log, man_owner->pw_uid, -1) < 0)
+			error (0, errno, _("can't chown %s"), log);
+#endif /* SECURE_MAN_UID */
+		MYDBM_CLOSE (dbf);
+		goto out;
+	}
+
+	memset (&dbpaths, 0, sizeof dbpaths);
+	push_cleanup (cleanup, &dbpaths, 0);
+	push_cleanup (cleanup_sigsafe, &dbpaths, 1);
+	database = xasprintf ("%s/%d", catpath, getpid ());
+	set_dbpaths (&dbpaths, dbname);
+	debug ("compacting %s\n", dbname);
+	if (dblog_compact (dbf, database) < 0)
+		error (0, errno, _("can't create index cache %s"), database);
+	else {
+		finish_up (&dbpaths);
+#ifdef SECURE_MAN_UID
+		if (global_manpath && euid == 0)
+			do_chown (&dbpaths, man_owner->pw_uid);
+#endif /* SECURE_MAN_UID */
+		/* Nobody else can write to the log until we close it. */
+		dblog_remove (dbname);
+	}
+	MYDBM_CLOSE (dbf);
+	cleanup_sigsafe (&dbpaths);
+	pop_cleanup ();
+	cleanup (&dbpaths);
+	pop_cleanup ();
+	free (database);
+	database = NULL;
+
+out:
+	free (log);
+	free (dbname);
+}
+
+/* Bring the full-text index used by man -K for this hierarchy up to date. */
+static void update_fulltext_index (const char *manpath, const char *catpath,
+				   int global_manpath ATTRIBUTE_UNUSED)
+{
+	char *index = xasprintf ("%s%s", catpath, MAN_FULLTEXT);
+
+	if (fulltext_update (manpath, index) < 0)
+		error (0, errno, _("can't write full-text index %s"), index);
+#ifdef SECURE_MAN_UID
+	else if (global_manpath && euid == 0)
+		xchown (index, man_owner->pw_uid, -1);
+#endif /* SECURE_MAN_UID */
+
+	free (index);
+}
+
+/* Write a reproducible copy of the database for this hierarchy. */
+static void write_portable_db (const char *manpath, const char *catpath,
+			       int global_manpath)
+{
+	char *manifest = xasprintf ("%s%s", catpath, MAN_MANIFEST);
+	char *portable_db = xasprintf ("%s%s", catpath, MAN_DB_PORTABLE);
+	char *digest = NULL;
+	MYDBM_FILE dbf;
+
+	dbf = MYDBM_RDOPEN (database);
+	if (!dbf) {
+		if (errno != ENOENT)
+			error (0, errno, _("can't open %s"), database);
+		goto out;
+	}
+
+	if (!manifest_is_current (manpath, manifest))
+		update_manifest (manpath, catpath, global_manpath, 1);
+	digest = manifest_digest (manifest);
+	if (!digest) {
+		error (0, errno, _("can't read manifest %s"), manifest);
+		MYDBM_CLOSE (dbf);
+		goto out;
+	}
+
+	if (dbportable_wr (dbf, portable_db, digest) < 0)
+		error (0, errno, _("can't write portable database %s"),
+		       portable_db);
+	else {
+		struct timespec times[2];
+
+		/* Give it the same modification time as the database it
+		 * came from, so that it isn't loaded back in next time.
+		 */
+		times[0] = times[1] = MYDBM_GET_TIME (dbf);
+		utimens (portable_db, times);
+#ifdef SECURE_MAN_UID
+		if (global_manpath && euid == 0)
+			xchown (portable_db, man_owner->pw_uid, -1);
+#endif /* SECURE_MAN_UID */
+	}
+	MYDBM_CLOSE (dbf);
+
+out:
+	free (digest);
+	free (portable_db);
+	free (manifest);
 }
 
 static int process_manpath (const char *manpath, int global_manpath,
@@ -561,7 +709,9 @@ static int process_manpath (const char *manpath, int global_manpath,
 	struct stat st;
 	int run_mandb = 0;
 	struct dbpaths dbpaths;
+	MYDBM_FILE held = NULL;
 	int amount = 0;
+	int replaced = 0;
 
 	if (global_manpath) { 	/* system db */
 		catpath = get_catpath (manpath, SYSTEM_CAT);
@@ -592,6 +742,17 @@ static int process_manpath (const char *manpath, int global_manpath,
 	} else
 		run_mandb = 1;
 
+	/* Keep the database open for writing until this run is done with
+	 * it.  Everything below that opens it shares this handle, so all
+	 * the changes reach its log together, and readers never see a run
+	 * half applied.
+	 */
+	if (!opt_test) {
+		char *dbname = mkdbname (catpath);
+		held = MYDBM_RWOPEN (dbname);
+		free (dbname);
+	}
+
 	force_rescan = 0;
 	if (purge) {
 		database = mkdbname (catpath);
@@ -612,15 +773,37 @@ static int process_manpath (const char *manpath, int global_manpath,
 		amount += ret;
 	}
 
-	if (!opt_test && amount) {
+	replaced = !opt_test && amount && dbpaths.replace;
+	if (replaced) {
+		char *dbname = mkdbname (catpath);
+
+		/* Index sections while the new database is still ours
+		 * alone, so that the index goes straight into it.
+		 */
+		dblog_bypass = 1;
+		update_sections_index (1);
+		dblog_bypass = 0;
+		/* Anything purged from the old database goes with it. */
+		if (held) {
+			MYDBM_CLOSE (held);
+			held = NULL;
+		}
 		finish_up (&dbpaths);
 #ifdef SECURE_MAN_UID
 		if (global_manpath && euid == 0)
 			do_chown (&dbpaths, man_owner->pw_uid);
 #endif /* SECURE_MAN_UID */
+		/* Any log of changes belonged to the old database. */
+		dblog_remove (dbname);
+		free (dbname);
 	}
 
+	if (!opt_test && run_mandb && database_exists (catpath))
+		update_manifest (manpath, catpath, global_manpath, amount > 0);
+
 out:
+	if (from_fragments)
+		free_fragments ();
 	cleanup_sigsafe (&dbpaths);
 	pop_cleanup ();
 	cleanup (&dbpaths);
@@ -635,6 +818,29 @@ out:
 		database = NULL;
 	}
 
+	if (run_mandb && !opt_test && amount >= 0) {
+		database = mkdbname (catpath);
+		update_sections_index (amount > 0 && !replaced);
+		free (database);
+		database = NULL;
+	}
+
+	if (held)
+		MYDBM_CLOSE (held);
+
+	if (run_mandb && !opt_test && amount >= 0)
+		compact_db (catpath, global_manpath);
+
+	if (fulltext_index && run_mandb && !opt_test && amount >= 0)
+		update_fulltext_index (manpath, catpath, global_manpath);
+
+	if (portable && run_mandb && !opt_test && amount >= 0) {
+		database = mkdbname (catpath);
+		write_portable_db (manpath, catpath, global_manpath);
+		free (database);
+		database = NULL;
+	}
+
 	free (catpath);
 
 	return amount;
@@ -807,6 +1013,11 @@ int main (int argc, char *argv[])
 	if (argp_parse (&argp, argc, argv, 0, 0, 0))
 		exit (FAIL);
 
+	/* Another mandb may be updating the same databases; let it finish
+	 * rather than skipping our own updates.
+	 */
+	dblog_lock_wait = -1;
+
 #ifdef __profile__
 	cwd = xgetcwd ();
 	if (!cwd) {
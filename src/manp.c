@@ -69,6 +69,7 @@
 
 #include "error.h"
 #include "cleanup.h"
+#include "manifest.h"
 
 #ifdef SECURE_MAN_UID
 # include "security.h"
@@ -101,6 +102,9 @@ static char *tmplist[MAXDIRS];
 char *user_config_file = NULL;
 int disable_cache;
 int min_cat_width = 80, max_cat_width = 80, cat_width = 0;
+int render_cache_size = RENDER_CACHE_SIZE;
+int stale_cats;
+int fulltext_index;
 
 static char *has_mandir (const char *p);
 static char *fsstnd (const char *path);
@@ -783,6 +787,10 @@ static void add_to_dirlist (FILE *config, int user)
 			goto next;
 		else if (strncmp (bp, "NOCACHE", 7) == 0)
 			disable_cache = 1;
+		else if (strncmp (bp, "STALECATS", 9) == 0)
+			stale_cats = 1;
+		else if (strncmp (bp, "FULLTEXT", 8) == 0)
+			fulltext_index = 1;
 		else if (strncmp (bp, "NO", 2) == 0)
 			goto next;	/* match any word starting with NO */
 		else if (sscanf (bp, "MANBIN %*s") == 1)
@@ -809,6 +817,8 @@ static void add_to_dirlist (FILE *config, int user)
 			max_cat_width = val;
 		else if (sscanf (bp, "CATWIDTH %d", &val) == 1)
 			cat_width = val;
+		else if (sscanf (bp, "RENDERCACHESIZE %d", &val) == 1)
+			render_cache_size = val;
 	 	else {
 			error (0, 0, _("can't parse directory list `%s'"), bp);
 			gripe_reading_mp_config (CONFIG_FILE);
@@ -1371,6 +1381,27 @@ int is_global_mandir (const char *dir)
 	return 0;
 }
 
+/* Tell the manifest code where mandb keeps the manifest for each element
+ * of the manpath, so that lookups within those hierarchies can use it.
+ * This must match the catpath that mandb uses for the database.
+ */
+void register_manifests (char **mp)
+{
+	for (; *mp; ++mp) {
+		char *catpath, *manifest;
+
+		if (is_global_mandir (*mp))
+			catpath = get_catpath (*mp, SYSTEM_CAT);
+		else
+			catpath = get_catpath (*mp, USER_CAT);
+		manifest = xasprintf ("%s%s", catpath ? catpath : *mp,
+				      MAN_MANIFEST);
+		manifest_register (*mp, manifest);
+		free (manifest);
+		free (catpath);
+	}
+}
+
 /* Accept a manpath (not a full pathname to a file) and return an FSSTND 
    equivalent catpath */
 static char *fsstnd (const char *path)
@@ -41,6 +41,7 @@ extern void free_pathlist (char **mp);
 extern char *get_mandb_manpath (void);
 extern char *get_catpath (const char *name, int cattype);
 extern int is_global_mandir (const char *dir);
+extern void register_manifests (char **mp);
 extern void read_config_file (int optional);
 #ifdef SECURE_MAN_UID
 extern const char *get_def (const char *thing, const char *def);
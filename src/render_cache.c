@@ -0,0 +1,206 @@
+/*
+ * render_cache.c: cache of pages rendered for non-standard settings
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Cat pages are only saved for the standard terminal width range and
+ * formatting options, so anybody with a wider terminal or who disables
+ * hyphenation has every page formatted from scratch every time.  man
+ * therefore keeps pages formatted for other settings in a directory in
+ * each cat hierarchy, named after a digest of everything that affected the
+ * output (see render_cache_key() in man.c).  Access times record when each
+ * page was last used, and the least recently used pages are removed when
+ * the directory grows beyond its size limit.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "stat-time.h"
+#include "timespec.h"
+#include "utimens.h"
+#include "xvasprintf.h"
+
+#include "gettext.h"
+#define _(String) gettext (String)
+
+#include "manconfig.h"
+
+#include "digest.h"
+#include "error.h"
+#include "security.h"
+
+#include "render_cache.h"
+
+struct cache_entry {
+	char *name;
+	off_t size;
+	struct timespec atime;
+};
+
+/* Return the render cache directory for the cat hierarchy containing
+ * CAT_FILE, or NULL if CAT_FILE is not within a section directory.
+ */
+char *render_cache_dir (const char *cat_file)
+{
+	char *root = xstrdup (cat_file), *slash, *dir;
+
+	slash = strrchr (root, '/');
+	if (!slash) {
+		free (root);
+		return NULL;
+	}
+	*slash = '\0';
+	slash = strrchr (root, '/');
+	if (slash)
+		*slash = '\0';
+	else
+		strcpy (root, ".");
+
+	dir = xasprintf ("%s%s", root, MAN_RENDER_CACHE);
+	free (root);
+	return dir;
+}
+
+/* Return the name of the file in DIR caching the page rendered with
+ * settings KEY.  64-bit FNV-1a is plenty to keep apart the handful of
+ * renderings of one page that might exist.
+ */
+char *render_cache_file (const char *dir, const char *key)
+{
+	uint64_t hash = fnv_update (FNV_INIT, key, strlen (key));
+
+#ifdef COMP_CAT
+	return xasprintf ("%s/%016llx.%s", dir, (unsigned long long) hash,
+			  COMPRESS_EXT);
+#else /* !COMP_CAT */
+	return xasprintf ("%s/%016llx", dir, (unsigned long long) hash);
+#endif /* COMP_CAT */
+}
+
+/* Make sure that the cache directory DIR exists, creating it if
+ * necessary.  If GLOBAL is set, it belongs to a system-wide hierarchy and
+ * so should be owned by the man user.  Return 0 if DIR is now usable.
+ */
+int create_cache_dir (const char *dir, int global ATTRIBUTE_UNUSED)
+{
+	if (mkdir (dir, 0755) == 0) {
+		debug ("created cache directory %s\n", dir);
+#ifdef SECURE_MAN_UID
+		if (global && geteuid () == 0) {
+			struct passwd *man_owner = get_man_owner ();
+			if (chown (dir, man_owner->pw_uid, -1))
+				error (0, errno, _("can't chown %s"), dir);
+		}
+#endif /* SECURE_MAN_UID */
+	} else if (errno != EEXIST) {
+		debug ("can't create cache directory %s: %s\n",
+		       dir, strerror (errno));
+		return -1;
+	}
+
+	return is_directory (dir) == 1 ? 0 : -1;
+}
+
+/* Record that FILE has just been used, leaving its modification time (that
+ * of its source) alone.
+ */
+void render_cache_touch (const char *file)
+{
+	struct timespec times[2];
+
+	times[0].tv_sec = 0;
+	times[0].tv_nsec = UTIME_NOW;
+	times[1].tv_sec = 0;
+	times[1].tv_nsec = UTIME_OMIT;
+	if (utimens (file, times))
+		debug ("can't set times on %s: %s\n", file, strerror (errno));
+}
+
+static int compare_atime (const void *a, const void *b)
+{
+	const struct cache_entry *left = a, *right = b;
+
+	return timespec_cmp (left->atime, right->atime);
+}
+
+/* Remove the least recently used pages from DIR until it holds no more
+ * than MAX_SIZE bytes.
+ */
+void render_cache_prune (const char *dir, off_t max_size)
+{
+	DIR *dirp;
+	struct dirent *ent;
+	struct cache_entry *entries = NULL;
+	size_t entries_len = 0, i;
+	off_t total = 0;
+
+	dirp = opendir (dir);
+	if (!dirp)
+		return;
+	while ((ent = readdir (dirp)) != NULL) {
+		struct stat st;
+		char *path;
+
+		/* Skip temporary files still being written. */
+		if (ent->d_name[0] == '.' || STRNEQ (ent->d_name, "cat", 3))
+			continue;
+		path = xasprintf ("%s/%s", dir, ent->d_name);
+		if (lstat (path, &st) == 0 && S_ISREG (st.st_mode)) {
+			entries = xnrealloc (entries, entries_len + 1,
+					     sizeof *entries);
+			entries[entries_len].name = path;
+			entries[entries_len].size = st.st_size;
+			entries[entries_len].atime = get_stat_atime (&st);
+			++entries_len;
+			total += st.st_size;
+		} else
+			free (path);
+	}
+	closedir (dirp);
+
+	if (total > max_size) {
+		debug ("render cache %s holds %llu bytes; pruning to %llu\n",
+		       dir, (unsigned long long) total,
+		       (unsigned long long) max_size);
+		qsort (entries, entries_len, sizeof *entries, compare_atime);
+		for (i = 0; i < entries_len && total > max_size; ++i) {
+			if (unlink (entries[i].name) == 0)
+				total -= entries[i].size;
+			else if (errno != ENOENT)
+				error (0, errno, _("can't unlink %s"),
+				       entries[i].name);
+		}
+	}
+
+	for (i = 0; i < entries_len; ++i)
+		free (entries[i].name);
+	free (entries);
+}
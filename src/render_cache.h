@@ -0,0 +1,30 @@
+/*
+ * render_cache.h: interface to the cache of pages rendered for
+ * non-standard settings
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <sys/types.h>
+
+extern char *render_cache_dir (const char *cat_file);
+extern char *render_cache_file (const char *dir, const char *key);
+extern int create_cache_dir (const char *dir, int global);
+extern void render_cache_touch (const char *file);
+extern void render_cache_prune (const char *dir, off_t max_size);
@@ -0,0 +1,84 @@
+/*
+ * strsearch.c: exercise the substring search routines
+ *
+ * Copyright (C) 2026 agent.
+ *
+ * This file is part of man-db.
+ *
+ * man-db is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * man-db is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with man-db; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Usage:
+ *   strsearch literal PATTERN
+ *	Print the literal that every match of the extended regular
+ *	expression PATTERN must contain, if there is one.
+ *   strsearch file STRING FILE
+ *	Exit successfully if FILE, read in blocks, contains STRING.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dirname.h"
+#include "xalloc.h"
+
+#include "manconfig.h"
+
+#include "pipeline.h"
+
+#include "strsearch.h"
+
+char *program_name;
+
+static void usage (void)
+{
+	fprintf (stderr, "usage: %s literal PATTERN\n", program_name);
+	fprintf (stderr, "       %s file STRING FILE\n", program_name);
+	exit (2);
+}
+
+int main (int argc, char **argv)
+{
+	program_name = base_name (argv[0]);
+	setlocale (LC_ALL, "");
+
+	if (argc == 3 && STREQ (argv[1], "literal")) {
+		char *literal = strsearch_regex_literal (argv[2]);
+
+		if (literal)
+			printf ("%s\n", literal);
+		free (literal);
+		return 0;
+	} else if (argc == 4 && STREQ (argv[1], "file")) {
+		struct strsearch *search = strsearch_new (argv[2], 0);
+		pipeline *p = pipeline_new ();
+		int found;
+
+		pipeline_want_infile (p, argv[3]);
+		pipeline_start (p);
+		found = strsearch_pipeline (search, p);
+		pipeline_free (p);
+		strsearch_free (search);
+		return found ? 0 : 1;
+	}
+
+	usage ();
+	return 2;
+}
@@ -55,6 +55,7 @@
 
 #include "pipeline.h"
 #include "decompress.h"
+#include "manifest.h"
 
 #include "globbing.h"
 #include "ult_src.h"
@@ -282,7 +283,7 @@ const char *ult_src (const char *name, const char *path,
 		/* If we don't have a buf, allocate and assign one */
 		if (!buf && ((flags & SOFT_LINK) || (flags & HARD_LINK))) {
 			buf = &new_buf;
-			if (lstat (base, buf) == -1) {
+			if (manifest_lstat (base, buf) == -1) {
 				if (quiet < 2)
 					error (0, errno, _("can't resolve %s"),
 					       base);
@@ -334,7 +335,7 @@ const char *ult_src (const char *name, const char *path,
 #ifdef COMP_SRC
 		struct stat st;
 
-		if (stat (base, &st) < 0) {
+		if (manifest_stat (base, &st) < 0) {
 			struct compression *comp = comp_file (base);
 
 			if (comp) {
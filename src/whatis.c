@@ -688,6 +688,41 @@ static void parse_whatis (const char * const *pages, char * const *lowpages,
 	}
 }
 
+/* If the database has a section index, return the keys of all entries
+ * that may be in the requested sections; otherwise NULL.
+ */
+static char **lookup_sections (MYDBM_FILE dbf)
+{
+	char **keys = NULL;
+	size_t keys_len = 0;
+	char * const *section;
+
+	for (section = sections; *section; ++section) {
+		char **indexed = dbsections_lookup (dbf, *section);
+		size_t indexed_len = 0;
+
+		if (!indexed) {
+			if (keys) {
+				size_t i;
+				for (i = 0; i < keys_len; ++i)
+					free (keys[i]);
+				free (keys);
+			}
+			return NULL;
+		}
+		while (indexed[indexed_len])
+			++indexed_len;
+		keys = xnrealloc (keys, keys_len + indexed_len + 1,
+				  sizeof *keys);
+		memcpy (keys + keys_len, indexed,
+			(indexed_len + 1) * sizeof *keys);
+		keys_len += indexed_len;
+		free (indexed);
+	}
+
+	return keys;
+}
+
 /* cjwatson: Optimized functions don't seem to be correct in some
  * circumstances; disabled for now.
  */
@@ -702,6 +737,7 @@ static void do_apropos (MYDBM_FILE dbf,
 	int *found_here;
 	int (*combine) (int, int *);
 	int i;
+	char **indexed = NULL, **next_indexed = NULL;
 #ifndef BTREE
 	datum nextkey;
 #else /* BTREE */
@@ -717,11 +753,18 @@ static void do_apropos (MYDBM_FILE dbf,
 	combine = require_all ? all_set : any_set;
 
 #ifndef BTREE
-	key = MYDBM_FIRSTKEY (dbf);
+	/* With a section index, we need only look at those sections. */
+	if (sections)
+		indexed = lookup_sections (dbf);
+	if (indexed) {
+		next_indexed = indexed;
+		key = dbsections_next_key (&next_indexed);
+	} else
+		key = MYDBM_FIRSTKEY (dbf);
 	while (MYDBM_DPTR (key)) {
 		cont = MYDBM_FETCH (dbf, key);
 #else /* BTREE */
-	end = btree_nextkeydata (dbf, &key, &cont);
+	end = dblog_nextkeydata (dbf, &key, &cont);
 	while (!end) {
 #endif /* !BTREE */
 		char *tab;
@@ -729,6 +772,10 @@ static void do_apropos (MYDBM_FILE dbf,
 
 		memset (&info, 0, sizeof (info));
 
+		/* Indexed entries may since have been deleted. */
+		if (!MYDBM_DPTR (cont) && indexed)
+			goto nextpage;
+
 		/* bug#4372, NULL pointer dereference in MYDBM_DPTR (cont),
 		 * fix by dassen@wi.leidenuniv.nl (J.H.M.Dassen), thanx Ray.
 		 * cjwatson: In that case, complain and exit, otherwise we
@@ -797,19 +844,23 @@ static void do_apropos (MYDBM_FILE dbf,
 			*tab = '\t';
 nextpage:
 #ifndef BTREE
-		nextkey = MYDBM_NEXTKEY (dbf, key);
+		if (indexed)
+			nextkey = dbsections_next_key (&next_indexed);
+		else
+			nextkey = MYDBM_NEXTKEY (dbf, key);
 		MYDBM_FREE_DPTR (cont);
 		MYDBM_FREE_DPTR (key);
 		key = nextkey; 
 #else /* BTREE */
 		MYDBM_FREE_DPTR (cont);
 		MYDBM_FREE_DPTR (key);
-		end = btree_nextkeydata (dbf, &key, &cont);
+		end = dblog_nextkeydata (dbf, &key, &cont);
 #endif /* !BTREE */
 		info.addr = NULL; /* == MYDBM_DPTR (cont), freed above */
 		free_mandata_elements (&info);
 	}
 
+	free (indexed);
 	for (i = 0; i < num_pages; ++i)
 		free (lowpages[i]);
 	free (lowpages);
@@ -944,6 +995,7 @@ int main (int argc, char *argv[])
 		free (get_manpath (NULL));
 
 	create_pathlist (manp, manpathlist);
+	register_manifests (manpathlist);
 
 	display_seen = hashtable_create (&null_hashtable_free);
 
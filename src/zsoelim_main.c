@@ -139,6 +139,7 @@ int main (int argc, char *argv[])
 	free (all_locales);
 
 	create_pathlist (manp, manpathlist);
+	register_manifests (manpathlist);
 
 	/* parse files in command line order */
 	for (i = 0; i < num_files; ++i) {